@@ -0,0 +1,269 @@
+//------------------------------------------------------------------------------
+//  File: 	benchmark.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Benchmark of the hot paths, see benchmark.h.
+//
+//  Each case is run for a number of operations between two reads of the
+//  monotonic clock and of the counters of the mock bus. The temperature of
+//  the range cases sweeps 30..65..30 C in steps of 0.1 C, with 500 ms of
+//  simulated time per step, so hysteresis and dwell time take effect as in
+//  the control loop.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "benchmark.h"
+#include "i2cbus.h"
+#include "coolinghat.h"
+#include "display.h"
+#include "ssd1306_i2c.h"
+
+#define BENCH_SWEEP_STEPS	700	// 0.1 C steps of a sweep up and down
+#define BENCH_STEP_MS		500	// simulated time per step
+#define BENCH_HISTORY		1024	// records of the sparkline history
+
+typedef struct Bench
+{
+    I2cBus		bus;
+    CoolingHat		hat;
+    ssd1306_ctx		display;
+    DisplayText		text;		// text page of display
+    History		history;	// samples of the sparkline
+    Sparkline		sparkline;
+    SparklinePage	sparklinePage;	// sparkline page of display
+    DisplaySnapshot	snapshot;
+    FanPolicy		policy;
+    FanState		state;
+    long long		nowMs;
+    volatile int	sink;		// keeps results from being optimized out
+} Bench;
+
+typedef struct BenchCase
+{
+    const char*	pName;
+    void	(*pRun)( Bench* pBench, long i );
+    int		divisor;	// fraction of the iterations to run
+} BenchCase;
+
+
+//------------------------------------------------------------------------------
+//  static double sweepTemperature( long i )
+//	Returns the temperature of step i of the sweep, degrees Celsius
+//------------------------------------------------------------------------------
+static double sweepTemperature( long i )
+{
+    long step = i % BENCH_SWEEP_STEPS;
+
+    if ( step > BENCH_SWEEP_STEPS / 2 )
+    {
+	step = BENCH_SWEEP_STEPS - step;
+    }
+    return 30.0 + step / 10.0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void applyBand( Bench* pBench, int band )
+//	Write the fan and led settings of band to the hat, as setTempControls
+//	does in the control loop.
+//------------------------------------------------------------------------------
+static void applyBand( Bench* pBench, int band )
+{
+    const FanBand* pBand = &pBench->policy.bands[ band ];
+
+    hatSetFan( &pBench->hat, pBand->fanValue );
+    hatSetRGB( &pBench->hat, HAT_NUM_LEDS, pBand->red, pBand->green,
+	       pBand->blue );
+}
+
+
+//------------------------------------------------------------------------------
+//  Benchmark cases
+//------------------------------------------------------------------------------
+static void benchDrawText( Bench* pBench, long i )
+{
+    (void) i;
+    ssd1306_drawText( &pBench->display, 56, 0, "Temp:47.3C" );
+}
+
+static void benchDisplayUnchanged( Bench* pBench, long i )
+{
+    (void) i;
+    pBench->sink += ssd1306_display( &pBench->display );
+}
+
+static void benchDisplayColumn( Bench* pBench, long i )
+{
+    // One byte of one page changes per frame
+    pBench->display.buffer[ i % pBench->display.width ] ^= 0x01;
+    pBench->sink += ssd1306_display( &pBench->display );
+}
+
+static void benchDisplayFull( Bench* pBench, long i )
+{
+    (void) i;
+    ssd1306_invalidate( &pBench->display );
+    pBench->sink += ssd1306_display( &pBench->display );
+}
+
+static void benchRenderUnchanged( Bench* pBench, long i )
+{
+    (void) i;
+    pBench->sink += displayRender( &pBench->display, &pBench->text, &pBench->snapshot );
+}
+
+static void benchRenderNewTemperature( Bench* pBench, long i )
+{
+    pBench->snapshot.temperature = sweepTemperature( i );
+    pBench->sink += displayRender( &pBench->display, &pBench->text, &pBench->snapshot );
+}
+
+static void benchSparklineSample( Bench* pBench, long i )
+{
+    HistoryRecord record;
+
+    // One new sample per frame, as at the default periods
+    memset( &record, 0, sizeof( record ));
+    record.temperature = historyTemperature( sweepTemperature( i ));
+    historyAppend( &pBench->history, &record );
+    sparklineUpdate( &pBench->sparkline, &pBench->history,
+		     pBench->display.width, pBench->display.height );
+    pBench->sink += displayRenderSparkline( &pBench->display,
+					    &pBench->sparklinePage,
+					    &pBench->sparkline,
+					    &pBench->snapshot );
+}
+
+static void benchTemperatureRange( Bench* pBench, long i )
+{
+    pBench->sink += policyBand( &pBench->policy, sweepTemperature( i ));
+}
+
+static void benchSetTempControls( Bench* pBench, long i )
+{
+    int band = policyBand( &pBench->policy, sweepTemperature( i ));
+
+    if ( band >= 0 )
+    {
+	applyBand( pBench, band );
+    }
+}
+
+static void benchPolicyUpdate( Bench* pBench, long i )
+{
+    pBench->nowMs += BENCH_STEP_MS;
+    if ( policyUpdate( &pBench->policy, &pBench->state, sweepTemperature( i ),
+		       pBench->nowMs ))
+    {
+	applyBand( pBench, pBench->state.band );
+    }
+}
+
+static const BenchCase gCases[] =
+{
+    { "ssd1306_drawText",		benchDrawText,			1 },
+    { "ssd1306_display unchanged",	benchDisplayUnchanged,		1 },
+    { "ssd1306_display 1 column",	benchDisplayColumn,
+					BENCH_FRAME_DIVISOR },
+    { "ssd1306_display full",		benchDisplayFull,
+					BENCH_FRAME_DIVISOR },
+    { "showProperties unchanged",	benchRenderUnchanged,
+					BENCH_FRAME_DIVISOR },
+    { "showProperties new temp",	benchRenderNewTemperature,
+					BENCH_FRAME_DIVISOR },
+    { "sparkline new sample",		benchSparklineSample,
+					BENCH_FRAME_DIVISOR },
+    { "temperatureRange",		benchTemperatureRange,		1 },
+    { "setTempControls",		benchSetTempControls,		1 },
+    { "policyUpdate + settings",	benchPolicyUpdate,		1 },
+};
+
+
+//------------------------------------------------------------------------------
+//  static long long nowNs()
+//	Returns the monotonic time in nanoseconds
+//------------------------------------------------------------------------------
+static long long nowNs()
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+//------------------------------------------------------------------------------
+//  int benchmarkRun( const FanPolicy* pPolicy, long iterations )
+//	Run all cases with the ranges of pPolicy, each for iterations
+//	operations or the fraction of it of the case, and print the results
+//	on stdout.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int benchmarkRun( const FanPolicy* pPolicy, long iterations )
+{
+    static Bench	bench;	// the display context is too big for the stack
+    int			c;
+
+    memset( &bench, 0, sizeof( bench ));
+    bench.policy = *pPolicy;
+    policyResetState( &bench.state );
+    if ( historyInit( &bench.history, BENCH_HISTORY ) != 0 )
+    {
+	return -1;
+    }
+
+    i2cBusOpen( &bench.bus, &gI2cBackendMock, NULL );
+    hatOpen( &bench.hat, &bench.bus, COOLINGHAT_I2C_ADDRESS );
+    ssd1306_init( &bench.display, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT );
+    ssd1306_setBus( &bench.display, &bench.bus );
+    ssd1306_begin( &bench.display, SSD1306_SWITCHCAPVCC, SSD1306_I2C_ADDRESS );
+
+    bench.snapshot.temperature = 47.3;
+    bench.snapshot.cpuBusy = 12.0;
+    snprintf( bench.snapshot.diskInfoTxt, METRICS_TEXT_SIZE,
+	      "Disk:12345/29000MB" );
+    snprintf( bench.snapshot.ipInfoTxt, METRICS_TEXT_SIZE,
+	      "eth0:IP:192.168.100.200" );
+
+    printf( "%-28s %12s %12s %12s\n", "case", "ns/op", "bytes/op",
+	    "transfers/op" );
+
+    for ( c = 0; c < (int)(sizeof( gCases ) / sizeof( gCases[ 0 ] )); c++ )
+    {
+	const BenchCase* pCase = &gCases[ c ];
+	long		 n = iterations / pCase->divisor;
+	unsigned long	 bytes = bench.bus.nBytes;
+	unsigned long	 transfers = bench.bus.nTransfers;
+	long long	 startNs;
+	long long	 elapsedNs;
+	long		 i;
+
+	if ( n < 1 )
+	{
+	    n = 1;
+	}
+
+	startNs = nowNs();
+	for ( i = 0; i < n; i++ )
+	{
+	    pCase->pRun( &bench, i );
+	}
+	elapsedNs = nowNs() - startNs;
+
+	printf( "%-28s %12.1f %12.2f %12.3f\n", pCase->pName,
+		(double)elapsedNs / n,
+		(double)(bench.bus.nBytes - bytes) / n,
+		(double)(bench.bus.nTransfers - transfers) / n );
+    }
+
+    ssd1306_end( &bench.display );
+    hatClose( &bench.hat );
+    i2cBusClose( &bench.bus );
+    historyClose( &bench.history );
+    return 0;
+}
@@ -0,0 +1,27 @@
+//------------------------------------------------------------------------------
+//  File: 	benchmark.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Benchmark of the hot paths of the control loop and the display: text
+//  drawing, frame transfer, the display pages, range selection and applying
+//  the settings of a range. The display and the hat are driven through the
+//  mock I2C backend (i2cbackend.h), so it needs no hardware and measures the
+//  CPU time of the code itself, plus the I2C traffic it would cause.
+//
+//  For each case the time per operation is printed, and for the cases that
+//  write to the bus the bytes and transfers per operation.
+//
+//------------------------------------------------------------------------------
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "fanpolicy.h"
+
+#define BENCH_ITERATIONS	1000000	// operations of the cheap cases
+#define BENCH_FRAME_DIVISOR	10	// frame cases do fewer operations
+
+int	benchmarkRun( const FanPolicy* pPolicy, long iterations );
+
+#endif
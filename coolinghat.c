@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+//  File: 	coolinghat.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Smart Cooling Hat driver, see coolinghat.h.
+//
+//  A register whose cached value is unknown (after opening, or after a
+//  failed write) is always written. A register write is a transfer of the
+//  register number followed by the value; a block write is the first
+//  register number followed by the values.
+//
+//------------------------------------------------------------------------------
+#include "coolinghat.h"
+
+
+//------------------------------------------------------------------------------
+//  int hatOpen( CoolingHat* pHat, I2cBus* pBus, unsigned int i2caddr )
+//	Attach to the hat at I2C address i2caddr on pBus, which must be open.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int hatOpen( CoolingHat* pHat, I2cBus* pBus, unsigned int i2caddr )
+{
+    pHat->pBus = pBus;
+    pHat->i2caddr = i2caddr;
+    pHat->nTransfers = 0;
+#ifdef COOLINGHAT_BLOCKWRITE
+    pHat->bBlockWrite = true;
+#else
+    pHat->bBlockWrite = false;
+#endif
+    hatInvalidate( pHat );
+
+    return (pBus != NULL && i2cBusIsOpen( pBus )) ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  void hatSetBlockWrite( CoolingHat* pHat, bool bBlockWrite )
+//	Select whether runs of consecutive registers are written in one I2C
+//	transfer. Only enable this if the hat firmware supports it.
+//------------------------------------------------------------------------------
+void hatSetBlockWrite( CoolingHat* pHat, bool bBlockWrite )
+{
+    pHat->bBlockWrite = bBlockWrite;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int hatWrite( CoolingHat* pHat, int first, const int* pValues,
+//			 int count )
+//	Write count values to the registers starting at first, skipping the
+//	registers whose cached value is equal. With block writes the span from
+//	the first to the last changed register goes out in one transfer.
+//	Returns 0 on success, -1 otherwise; the cache of the registers that
+//	could not be written becomes unknown.
+//------------------------------------------------------------------------------
+static int hatWrite( CoolingHat* pHat, int first, const int* pValues,
+		     int count )
+{
+    int low = count;
+    int high = -1;
+    int i;
+
+    if ( pHat->pBus == NULL )
+    {
+	return -1;
+    }
+
+    for ( i = 0; i < count; i++ )
+    {
+	if ( pHat->cache[ first + i ] != pValues[ i ] )
+	{
+	    low = (i < low) ? i : low;
+	    high = i;
+	}
+    }
+    if ( high < 0 )
+    {
+	return 0;	// nothing changed
+    }
+
+    if ( pHat->bBlockWrite && high > low )
+    {
+	unsigned char	buf[ 1 + HAT_NUM_REGS ];
+	int		n = 0;
+
+	buf[ n++ ] = first + low;
+	for ( i = low; i <= high; i++ )
+	{
+	    buf[ n++ ] = pValues[ i ];
+	}
+
+	pHat->nTransfers++;
+	if ( i2cBusWrite( pHat->pBus, I2cPrioHigh, pHat->i2caddr, buf, n ) != 0 )
+	{
+	    for ( i = low; i <= high; i++ )
+	    {
+		pHat->cache[ first + i ] = -1;
+	    }
+	    return -1;
+	}
+	for ( i = low; i <= high; i++ )
+	{
+	    pHat->cache[ first + i ] = pValues[ i ];
+	}
+	return 0;
+    }
+
+    for ( i = low; i <= high; i++ )
+    {
+	if ( pHat->cache[ first + i ] == pValues[ i ] )
+	{
+	    continue;
+	}
+
+	unsigned char buf[ 2 ] = { first + i, pValues[ i ] };
+
+	pHat->nTransfers++;
+	if ( i2cBusWrite( pHat->pBus, I2cPrioHigh, pHat->i2caddr, buf, 2 ) != 0 )
+	{
+	    pHat->cache[ first + i ] = -1;
+	    return -1;
+	}
+	pHat->cache[ first + i ] = pValues[ i ];
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int hatSetFan( CoolingHat* pHat, int fanValue )
+//	Set the fan register: 0 off, 1 full speed, 2..9 is 20%..90%.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int hatSetFan( CoolingHat* pHat, int fanValue )
+{
+    return hatWrite( pHat, HAT_REG_FAN, &fanValue, 1 );
+}
+
+
+//------------------------------------------------------------------------------
+//  double hatFanDuty( int fanValue )
+//	Returns the fan speed of fan register value fanValue, 0 (off) .. 1
+//	(full speed)
+//------------------------------------------------------------------------------
+double hatFanDuty( int fanValue )
+{
+    if ( fanValue == HAT_FAN_FULL )
+    {
+	return 1.0;
+    }
+    return (fanValue >= 2 && fanValue <= 9) ? fanValue / 10.0 : 0.0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int hatSetRGB( CoolingHat* pHat, int led, int red, int green, int blue )
+//	Set the color of led 0..HAT_NUM_LEDS-1, or of all leds if led is
+//	HAT_NUM_LEDS or more.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int hatSetRGB( CoolingHat* pHat, int led, int red, int green, int blue )
+{
+    int values[ 4 ];
+
+    if ( led < 0 )
+    {
+	return -1;
+    }
+
+    values[ 0 ] = (led >= HAT_NUM_LEDS) ? HAT_ALL_LEDS : led;
+    values[ 1 ] = red;
+    values[ 2 ] = green;
+    values[ 3 ] = blue;
+
+    // The color registers apply to the selected led: select it first if
+    // it changed, and write all three colors for a newly selected led
+    if ( pHat->cache[ HAT_REG_LED ] != values[ 0 ] )
+    {
+	pHat->cache[ HAT_REG_RED ] = -1;
+	pHat->cache[ HAT_REG_GREEN ] = -1;
+	pHat->cache[ HAT_REG_BLUE ] = -1;
+    }
+    return hatWrite( pHat, HAT_REG_LED, values, 4 );
+}
+
+
+//------------------------------------------------------------------------------
+//  void hatInvalidate( CoolingHat* pHat )
+//	Forget the cached register values, so the next settings are written
+//	unconditionally (e.g. after the hat was power cycled).
+//------------------------------------------------------------------------------
+void hatInvalidate( CoolingHat* pHat )
+{
+    int i;
+
+    for ( i = 0; i < HAT_NUM_REGS; i++ )
+    {
+	pHat->cache[ i ] = -1;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void hatClose( CoolingHat* pHat )
+//	Detach from the bus; the bus itself stays open.
+//------------------------------------------------------------------------------
+void hatClose( CoolingHat* pHat )
+{
+    pHat->pBus = NULL;
+    hatInvalidate( pHat );
+}
@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+//  File: 	coolinghat.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Driver for the fan and RGB leds of the Smart Cooling Hat (DF-DFR0672).
+//  The hat is written through the shared I2C bus at high priority, so fan
+//  updates go before pending display transfers. The last value written to
+//  each register is cached, so settings that did not change are not written
+//  again.
+//
+//------------------------------------------------------------------------------
+#ifndef COOLINGHAT_H
+#define COOLINGHAT_H
+
+#include <stdbool.h>
+
+#include "i2cbus.h"
+
+#define COOLINGHAT_I2C_ADDRESS	0x0d
+
+// Registers
+#define HAT_REG_LED		0x00	// led to set, 0xff for all leds
+#define HAT_REG_RED		0x01
+#define HAT_REG_GREEN		0x02
+#define HAT_REG_BLUE		0x03
+#define HAT_REG_FAN		0x08	// 0 off, 1 full, 2..9 is 20%..90%
+#define HAT_FAN_FULL		0x01	// fan register value of full speed
+#define HAT_NUM_REGS		( HAT_REG_FAN + 1 )
+
+#define HAT_NUM_LEDS		3
+#define HAT_ALL_LEDS		0xff
+
+// Define to write consecutive registers as one I2C transfer, for hat
+// firmware that increments the register address on every data byte
+//#define COOLINGHAT_BLOCKWRITE
+
+typedef struct CoolingHat
+{
+    I2cBus*		pBus;
+    unsigned int	i2caddr;
+    bool		bBlockWrite;	// write register runs in one transfer
+    int			cache	[ HAT_NUM_REGS ];	// -1 if unknown
+    unsigned long	nTransfers;	// I2C transfers issued
+} CoolingHat;
+
+int	hatOpen( CoolingHat* pHat, I2cBus* pBus, unsigned int i2caddr );
+void	hatSetBlockWrite( CoolingHat* pHat, bool bBlockWrite );
+int	hatSetFan( CoolingHat* pHat, int fanValue );
+double	hatFanDuty( int fanValue );
+int	hatSetRGB( CoolingHat* pHat, int led, int red, int green, int blue );
+void	hatInvalidate( CoolingHat* pHat );
+void	hatClose( CoolingHat* pHat );
+
+#endif
@@ -0,0 +1,222 @@
+//------------------------------------------------------------------------------
+//  File: 	cpustat.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  CPU utilization sampler, see cpustat.h.
+//
+//  A cpu line of /proc/stat reads
+//	cpu[N] user nice system idle iowait irq softirq steal guest guest_nice
+//  Guest time is already included in user and nice, so only the first eight
+//  counters are summed. Idle and iowait count as not busy.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "cpustat.h"
+
+#define CPUSTAT_FIELDS		8	// counters that make up the total
+#define CPUSTAT_IDLE		3	// field index of idle
+#define CPUSTAT_IOWAIT		4
+
+
+//------------------------------------------------------------------------------
+//  static const char* scanNumber( const char* p, const char* pEnd,
+//				   unsigned long long* pValue )
+//	Skip spaces and read a decimal number.
+//	Returns the position after the number, or NULL if there is none
+//------------------------------------------------------------------------------
+static const char* scanNumber( const char* p, const char* pEnd,
+			       unsigned long long* pValue )
+{
+    unsigned long long value = 0;
+
+    while ( p < pEnd && *p == ' ' )
+    {
+	p++;
+    }
+    if ( p >= pEnd || *p < '0' || *p > '9' )
+    {
+	return NULL;
+    }
+    while ( p < pEnd && *p >= '0' && *p <= '9' )
+    {
+	value = value * 10 + (*p++ - '0');
+    }
+    *pValue = value;
+    return p;
+}
+
+
+//------------------------------------------------------------------------------
+//  int cpuStatParse( const char* buf, int len, CpuTimes* pTimes, int maxCpus )
+//	Scan the cpu lines at the start of /proc/stat text into pTimes: [0] for
+//	the "cpu" line, [1 + N] for "cpuN" with N < maxCpus. Entries of cpus
+//	without a line have bPresent false.
+//	Returns the highest cpu number found + 1 (0 if there are no per-cpu
+//	lines), or -1 if a cpu line is malformed
+//------------------------------------------------------------------------------
+int cpuStatParse( const char* buf, int len, CpuTimes* pTimes, int maxCpus )
+{
+    const char*	p = buf;
+    const char*	pEnd = buf + len;
+    int		nCpus = 0;
+    int		i;
+
+    for ( i = 0; i <= maxCpus; i++ )
+    {
+	pTimes[ i ].bPresent = false;
+    }
+
+    while ( pEnd - p >= 3 && !memcmp( p, "cpu", 3 ))
+    {
+	unsigned long long	value;
+	CpuTimes		times = { 0, 0, true };
+	int			index = 0;
+
+	p += 3;
+	if ( p < pEnd && *p != ' ' )
+	{
+	    unsigned long long cpu;
+
+	    if ( (p = scanNumber( p, pEnd, &cpu )) == NULL )
+	    {
+		return -1;
+	    }
+	    index = (cpu < (unsigned long long)maxCpus) ? (int)cpu + 1 : -1;
+	}
+
+	for ( i = 0; i < CPUSTAT_FIELDS; i++ )
+	{
+	    const char* pNext = scanNumber( p, pEnd, &value );
+
+	    if ( pNext == NULL )
+	    {
+		// Older kernels have fewer fields
+		if ( i <= CPUSTAT_IOWAIT )
+		{
+		    return -1;
+		}
+		break;
+	    }
+	    p = pNext;
+	    times.total += value;
+	    if ( i != CPUSTAT_IDLE && i != CPUSTAT_IOWAIT )
+	    {
+		times.busy += value;
+	    }
+	}
+
+	if ( index >= 0 )
+	{
+	    pTimes[ index ] = times;
+	    if ( index > nCpus )
+	    {
+		nCpus = index;
+	    }
+	}
+
+	// Next line
+	while ( p < pEnd && *p != '\n' )
+	{
+	    p++;
+	}
+	if ( p >= pEnd )
+	{
+	    break;
+	}
+	p++;
+    }
+
+    return nCpus;
+}
+
+
+//------------------------------------------------------------------------------
+//  int cpuStatInit( CpuStat* pStat )
+//	Open /proc/stat and take the first sample, which has no busy values
+//	yet.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int cpuStatInit( CpuStat* pStat )
+{
+    memset( pStat, 0, sizeof( *pStat ));
+    pStat->fd = open( CPUSTAT_PATH, O_RDONLY | O_CLOEXEC );
+    if ( pStat->fd < 0 )
+    {
+	fprintf( stderr, "Could not open %s\n", CPUSTAT_PATH );
+	return -1;
+    }
+    return cpuStatSample( pStat );
+}
+
+
+//------------------------------------------------------------------------------
+//  int cpuStatSample( CpuStat* pStat )
+//	Read /proc/stat and compute the busy percentages since the previous
+//	sample. A cpu that went offline keeps its previous busy value.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int cpuStatSample( CpuStat* pStat )
+{
+    CpuTimes	times	[ CPUSTAT_MAX_CPUS + 1 ];
+    bool	bHadSample = pStat->last[ 0 ].bPresent;
+    ssize_t	len;
+    int		nCpus;
+    int		i;
+
+    if ( pStat->fd < 0 )
+    {
+	return -1;
+    }
+
+    len = pread( pStat->fd, pStat->buffer, sizeof( pStat->buffer ), 0 );
+    if ( len <= 0 )
+    {
+	return -1;
+    }
+
+    nCpus = cpuStatParse( pStat->buffer, len, times, CPUSTAT_MAX_CPUS );
+    if ( nCpus < 0 || !times[ 0 ].bPresent )
+    {
+	return -1;
+    }
+
+    for ( i = 0; i <= CPUSTAT_MAX_CPUS; i++ )
+    {
+	if ( times[ i ].bPresent && pStat->last[ i ].bPresent &&
+	     times[ i ].total > pStat->last[ i ].total )
+	{
+	    unsigned long long total = times[ i ].total - pStat->last[ i ].total;
+	    unsigned long long busy = times[ i ].busy - pStat->last[ i ].busy;
+
+	    pStat->busy[ i ] = (busy > total) ? 100.0 : 100.0 * busy / total;
+	}
+	if ( times[ i ].bPresent )
+	{
+	    pStat->last[ i ] = times[ i ];
+	}
+    }
+
+    pStat->bValid = bHadSample;
+    pStat->nCpus = nCpus;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void cpuStatClose( CpuStat* pStat )
+//	Close /proc/stat.
+//------------------------------------------------------------------------------
+void cpuStatClose( CpuStat* pStat )
+{
+    if ( pStat->fd >= 0 )
+    {
+	close( pStat->fd );
+	pStat->fd = -1;
+    }
+}
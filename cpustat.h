@@ -0,0 +1,45 @@
+//------------------------------------------------------------------------------
+//  File: 	cpustat.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  CPU utilization from the time counters in /proc/stat. The file is kept
+//  open and read with one pread() per sample into a fixed buffer, which is
+//  scanned in place; the busy percentage of each core and of all cores
+//  together is computed from the difference with the previous sample.
+//
+//------------------------------------------------------------------------------
+#ifndef CPUSTAT_H
+#define CPUSTAT_H
+
+#include <stdbool.h>
+
+#define CPUSTAT_PATH		"/proc/stat"
+#define CPUSTAT_MAX_CPUS 	8
+#define CPUSTAT_BUFFER_SIZE	4096	// the cpu lines come first
+
+// Time counters of a cpu line, in clock ticks
+typedef struct CpuTimes
+{
+    unsigned long long	busy;	// all but idle and iowait
+    unsigned long long	total;
+    bool		bPresent;
+} CpuTimes;
+
+typedef struct CpuStat
+{
+    int		fd;
+    int		nCpus;				// highest cpu number + 1
+    CpuTimes	last	[ CPUSTAT_MAX_CPUS + 1 ];	// [0] is all cpus
+    double	busy	[ CPUSTAT_MAX_CPUS + 1 ];	// percent, [0] all cpus
+    bool	bValid;				// busy holds a delta
+    char	buffer	[ CPUSTAT_BUFFER_SIZE ];
+} CpuStat;
+
+int	cpuStatInit( CpuStat* pStat );
+int	cpuStatSample( CpuStat* pStat );
+void	cpuStatClose( CpuStat* pStat );
+int	cpuStatParse( const char* buf, int len, CpuTimes* pTimes, int maxCpus );
+
+#endif
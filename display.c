@@ -0,0 +1,840 @@
+//------------------------------------------------------------------------------
+//  File: 	display.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  OLED display page and its worker thread, see display.h.
+//
+//  RAM usage is not part of the snapshot: the worker retrieves it itself
+//  when it draws a page, to keep the syscall off the control loop.
+//
+//  The sparkline is drawn once per column: record n of the history is drawn
+//  in column n modulo the width, and the column after it is cleared, so the
+//  graph sweeps across the page like the trace of a scope and a new sample
+//  changes only those two columns. Showing the page copies the columns
+//  that changed into the display buffer, and ssd1306_display() sends them
+//  in one window over all rows of the graph.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include <sys/sysinfo.h>
+
+#include "display.h"
+#include "scheduler.h"
+
+#define SPARKLINE_READ		32	// history records read at a time
+
+
+#define DISPLAY_CHAR_WIDTH	6	// pixels per character of text size 1
+#define DISPLAY_NO_VALUE	LLONG_MIN	// no text formatted yet
+#define SPARKLINE_NO_RANGE	0	// no samples in the sparkline yet
+#define SPARKLINE_RANGE_OFFSET	512	// makes range degrees positive
+#define SPARKLINE_RANGE_SCALE	(1 << 20)	// title value per tenth degree
+
+// Place of a line on a page: y is a multiple of 8, so every line is in
+// whole pages of the buffer, and the text is cut off at width pixels
+typedef struct LinePosition
+{
+    int		x;
+    int		y;
+    int		width;
+    int		size;		// text size, see ssd1306_setTextSize
+} LinePosition;
+
+// Lines of the text page, in the order of DisplayLineId. The temperature
+// is drawn in the size 2 font, with the short lines to the right of it.
+static const LinePosition gLinePositions[ DISPLAY_NUM_LINES ] =
+{
+    {  78,  0,  50, 1 },	// CPU
+    {   0,  0,  72, 2 },	// temperature, 6 characters
+    {  78,  8,  50, 1 },	// RAM
+    { 110, 16,  18, 1 },	// THR
+    {   0, 16, 108, 1 },	// disk, up to THR
+    {   0, 24, 128, 1 }		// IP
+};
+
+// Title line of the sparkline page
+static const LinePosition gTitlePosition = { 0, 0, SSD1306_MAXWIDTH, 1 };
+
+
+//------------------------------------------------------------------------------
+//  static int appendText( char* pText, int length, const char* pAdd )
+//	Append pAdd to the text of length characters in a DISPLAY_TEXT_SIZE
+//	buffer, as far as it fits.
+//	Returns the new length
+//------------------------------------------------------------------------------
+static int appendText( char* pText, int length, const char* pAdd )
+{
+    while ( *pAdd != '\0' && length < DISPLAY_TEXT_SIZE - 1 )
+    {
+	pText[ length++ ] = *pAdd++;
+    }
+    pText[ length ] = '\0';
+    return length;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int appendNumber( char* pText, int length, long long value,
+//			     int decimals )
+//	Append value, divided by 10^decimals and with that many decimals, to
+//	the text of length characters, as far as it fits; e.g. 473 with one
+//	decimal is "47.3".
+//	Returns the new length
+//------------------------------------------------------------------------------
+static int appendNumber( char* pText, int length, long long value,
+			 int decimals )
+{
+    char		digits	[ 24 ];
+    unsigned long long	magnitude = (value < 0) ? -(unsigned long long)value
+						: (unsigned long long)value;
+    int			n = 0;
+
+    // Digits from the least significant one, with at least one before the
+    // decimal point
+    do
+    {
+	if ( n == decimals && decimals > 0 )
+	{
+	    digits[ n++ ] = '.';
+	}
+	digits[ n++ ] = '0' + magnitude % 10;
+	magnitude /= 10;
+    }
+    while ( magnitude > 0 || n <= decimals + (decimals > 0) );
+
+    if ( value < 0 )
+    {
+	digits[ n++ ] = '-';
+    }
+    while ( n > 0 && length < DISPLAY_TEXT_SIZE - 1 )
+    {
+	pText[ length++ ] = digits[ --n ];
+    }
+    pText[ length ] = '\0';
+    return length;
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool lineUpToDate( DisplayLine* pLine, long long value )
+//	Returns whether pLine shows value; if not, value is recorded as the
+//	value of the text that is about to be formatted
+//------------------------------------------------------------------------------
+static bool lineUpToDate( DisplayLine* pLine, long long value )
+{
+    if ( pLine->value == value )
+    {
+	return true;
+    }
+    pLine->value = value;
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+//  static long long textValue( const char* pText )
+//	Returns a hash (FNV-1a) of pText, the value of a text property; the
+//	text on the display may be cut off, so it cannot be compared itself
+//------------------------------------------------------------------------------
+static long long textValue( const char* pText )
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    while ( *pText != '\0' )
+    {
+	hash = (hash ^ (unsigned char)*pText++) * 1099511628211ULL;
+    }
+    return (long long)(hash >> 1);	// never DISPLAY_NO_VALUE
+}
+
+
+//------------------------------------------------------------------------------
+//  static long long tenthsOf( double value )
+//	Returns value in tenths, rounded half away from zero
+//------------------------------------------------------------------------------
+static long long tenthsOf( double value )
+{
+    double tenths = value * 10.0;
+
+    return (tenths >= 0.0) ? (long long)(tenths + 0.5)
+			   : -(long long)(0.5 - tenths);
+}
+
+
+//------------------------------------------------------------------------------
+//  static void drawLineAt( ssd1306_ctx* pDisplay,
+//			    const LinePosition* pPosition, DisplayLine* pLine,
+//			    const char* pText )
+//	Replace the text of pLine at pPosition in the display buffer with
+//	pText, cut off at the width of the position or the right edge of the
+//	display.
+//------------------------------------------------------------------------------
+static void drawLineAt( ssd1306_ctx* pDisplay, const LinePosition* pPosition,
+			DisplayLine* pLine, const char* pText )
+{
+    int		x = pPosition->x;
+    int		y = pPosition->y;
+    int		charWidth = DISPLAY_CHAR_WIDTH * pPosition->size;
+    int		maxWidth = pDisplay->width - x;
+    int		maxLength;
+    int		width;
+    int		page;
+
+    if ( maxWidth > pPosition->width )
+    {
+	maxWidth = pPosition->width;
+    }
+    maxLength = maxWidth / charWidth;
+    if ( y >= pDisplay->height || maxLength <= 0 )
+    {
+	return;
+    }
+
+    // Clear the old text, which may be longer than the new one
+    width = pLine->length * charWidth;
+    if ( width > maxWidth )
+    {
+	width = maxWidth;
+    }
+    for ( page = y / 8; page < (y + 8 * pPosition->size) / 8 &&
+			page < pDisplay->height / 8; page++ )
+    {
+	memset( pDisplay->buffer + page * pDisplay->width + x, 0, width );
+    }
+
+    if ( pText != pLine->text )
+    {
+	pLine->text[ 0 ] = '\0';
+	appendText( pLine->text, 0, pText );
+    }
+    pLine->length = strlen( pLine->text );
+    if ( pLine->length > maxLength )
+    {
+	pLine->length = maxLength;
+	pLine->text[ maxLength ] = '\0';
+    }
+    ssd1306_setTextSize( pDisplay, pPosition->size );
+    ssd1306_drawText( pDisplay, x, y, pLine->text );
+    ssd1306_setTextSize( pDisplay, 1 );
+}
+
+
+//------------------------------------------------------------------------------
+//  static void drawLine( ssd1306_ctx* pDisplay, DisplayLineId id,
+//			  DisplayLine* pLine, const char* pText )
+//	Replace the text of line id of the text page with pText.
+//------------------------------------------------------------------------------
+static void drawLine( ssd1306_ctx* pDisplay, DisplayLineId id,
+		      DisplayLine* pLine, const char* pText )
+{
+    drawLineAt( pDisplay, &gLinePositions[ id ], pLine, pText );
+}
+
+
+//------------------------------------------------------------------------------
+//  int displayRender( ssd1306_ctx* pDisplay, DisplayText* pText,
+//		       const DisplaySnapshot* pSnapshot )
+//	Update the text page pText in the display buffer with the properties
+//	in pSnapshot and the RAM usage, and transfer what changed to the
+//	display. Only the lines whose value changed are formatted and drawn;
+//	all of them if pText is not valid, e.g. after another page was shown.
+//	Returns 0 if all properties were displayed successfully; -1 otherwise
+//------------------------------------------------------------------------------
+int displayRender( ssd1306_ctx* pDisplay, DisplayText* pText,
+		   const DisplaySnapshot* pSnapshot )
+{
+    struct sysinfo 	sysInfo;
+    DisplayLine*	pLines = pText->lines;
+    int			nChanged = 0;
+    int			i;
+
+    if ( !pText->bValid )
+    {
+	// Start a new frame
+	ssd1306_clearDisplay( pDisplay );
+	for ( i = 0; i < DISPLAY_NUM_LINES; i++ )
+	{
+	    pLines[ i ].value = DISPLAY_NO_VALUE;
+	    pLines[ i ].length = 0;
+	    pLines[ i ].text[ 0 ] = '\0';
+	}
+	pText->bValid = true;
+    }
+
+    // Retrieve system info
+    if ( sysinfo( &sysInfo ) != 0 )
+    {
+	ssd1306_clearDisplay( pDisplay );
+	ssd1306_drawString( pDisplay, "sysinfo-Error" );
+	ssd1306_display( pDisplay );
+	pText->bValid = false;
+	return -1;
+    }
+
+    // Percent and tenths of a degree, rounded
+    if ( !lineUpToDate( &pLines[ DisplayLineCpu ],
+			(long long)(pSnapshot->cpuBusy + 0.5) ))
+    {
+	DisplayLine* pLine = &pLines[ DisplayLineCpu ];
+	int n = appendText( pLine->text, 0, "CPU:" );
+
+	n = appendNumber( pLine->text, n, pLine->value, 0 );
+	appendText( pLine->text, n, "%" );
+	drawLine( pDisplay, DisplayLineCpu, pLine, pLine->text );
+	nChanged++;
+    }
+
+    if ( !lineUpToDate( &pLines[ DisplayLineTemperature ],
+			tenthsOf( pSnapshot->temperature )))
+    {
+	DisplayLine* pLine = &pLines[ DisplayLineTemperature ];
+	int n = appendNumber( pLine->text, 0, pLine->value, 1 );
+
+	appendText( pLine->text, n, "C" );
+	drawLine( pDisplay, DisplayLineTemperature, pLine, pLine->text );
+	nChanged++;
+    }
+
+    // RAM in use, in percent
+    unsigned long long totalRam =
+	(unsigned long long)sysInfo.totalram * sysInfo.mem_unit;
+    unsigned long long freeRam =
+	(unsigned long long)sysInfo.freeram * sysInfo.mem_unit;
+    unsigned long long usedRam = (totalRam == 0) ? 0 :
+	(200 * (totalRam - freeRam) / totalRam + 1) / 2;
+
+    if ( !lineUpToDate( &pLines[ DisplayLineRam ], (long long)usedRam ))
+    {
+	DisplayLine* pLine = &pLines[ DisplayLineRam ];
+	int n = appendText( pLine->text, 0, "RAM:" );
+
+	n = appendNumber( pLine->text, n, pLine->value, 0 );
+	appendText( pLine->text, n, "%" );
+	drawLine( pDisplay, DisplayLineRam, pLine, pLine->text );
+	nChanged++;
+    }
+
+    if ( !lineUpToDate( &pLines[ DisplayLineThrottle ], pSnapshot->bThrottled ))
+    {
+	drawLine( pDisplay, DisplayLineThrottle, &pLines[ DisplayLineThrottle ],
+		  pSnapshot->bThrottled ? "THR" : "" );
+	nChanged++;
+    }
+
+    // The slow properties are already text
+    if ( !lineUpToDate( &pLines[ DisplayLineDisk ],
+			textValue( pSnapshot->diskInfoTxt )))
+    {
+	drawLine( pDisplay, DisplayLineDisk, &pLines[ DisplayLineDisk ],
+		  pSnapshot->diskInfoTxt );
+	nChanged++;
+    }
+    if ( !lineUpToDate( &pLines[ DisplayLineIp ],
+			textValue( pSnapshot->ipInfoTxt )))
+    {
+	drawLine( pDisplay, DisplayLineIp, &pLines[ DisplayLineIp ],
+		  pSnapshot->ipInfoTxt );
+	nChanged++;
+    }
+
+    // Nothing to transfer, unless the display has to be recovered
+    if ( nChanged == 0 && pDisplay->shadowvalid && !pDisplay->i2cerror )
+    {
+	return 0;
+    }
+    return ssd1306_display( pDisplay ) == 0 ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void sparklineAdd( Sparkline* pSparkline, uint64_t record,
+//			      int16_t value, int width, int nPages )
+//	Draw value (1/100 degrees Celsius) of history record number record in
+//	its column of the sparkline, and clear the column after it.
+//------------------------------------------------------------------------------
+static void sparklineAdd( Sparkline* pSparkline, uint64_t record,
+			  int16_t value, int width, int nPages )
+{
+    int		x = record % width;
+    int		gap = (x + 1) % width;
+    int		graphHeight = nPages * 8;
+    double	temperature = value / 100.0;
+    int		barHeight;
+    int		page;
+
+    // Bar height in pixels, at least the baseline
+    barHeight = (int)((temperature - SPARKLINE_MIN) * graphHeight /
+		      (SPARKLINE_MAX - SPARKLINE_MIN) + 0.5);
+    if ( value == HISTORY_NO_VALUE || barHeight < 1 )
+    {
+	barHeight = 1;
+    }
+    if ( barHeight > graphHeight )
+    {
+	barHeight = graphHeight;
+    }
+
+    for ( page = 0; page < nPages; page++ )
+    {
+	uint8_t* pRow = pSparkline->buffer + page * width;
+	int	 top = graphHeight - barHeight - page * 8;	// first bit set
+	uint8_t	 column;
+
+	if ( top <= 0 )
+	{
+	    column = 0xff;
+	}
+	else if ( top >= 8 )
+	{
+	    column = 0x00;
+	}
+	else
+	{
+	    column = (uint8_t)(0xff << top);	// LSB is the top pixel
+	}
+
+	pRow[ x ] = column;
+	pRow[ gap ] = 0x00;
+    }
+
+    pSparkline->values[ x ] = value;
+    if ( pSparkline->nValues < width - 1 )
+    {
+	pSparkline->nValues++;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void sparklineUpdate( Sparkline* pSparkline, const History* pHistory,
+//			  int width, int height )
+//	Add the records that were appended to pHistory since the previous call
+//	to the sparkline of a display of width x height pixels. Only the last
+//	width - 1 records are drawn.
+//------------------------------------------------------------------------------
+void sparklineUpdate( Sparkline* pSparkline, const History* pHistory,
+		      int width, int height )
+{
+    HistoryRecord	records	[ SPARKLINE_READ ];
+    uint64_t		count = historyCount( pHistory );
+    uint64_t		first;
+    int			nPages = height / 8 - 1;
+    int			nRead;
+    int			i;
+
+    if ( nPages > SPARKLINE_PAGES )
+    {
+	nPages = SPARKLINE_PAGES;
+    }
+    if ( nPages <= 0 || width <= 1 )
+    {
+	return;
+    }
+
+    // Older records would be overwritten again anyway
+    if ( count > (uint64_t)width && pSparkline->nextRecord < count - width )
+    {
+	pSparkline->nextRecord = count - width;
+    }
+
+    while ( pSparkline->nextRecord < count &&
+	    (nRead = historyRead( pHistory, pSparkline->nextRecord, records,
+				  SPARKLINE_READ, &first )) > 0 )
+    {
+	for ( i = 0; i < nRead; i++ )
+	{
+	    sparklineAdd( pSparkline, first + i, records[ i ].temperature,
+			  width, nPages );
+	}
+	pSparkline->nextRecord = first + nRead;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void copyColumn( uint8_t* pPage, const Sparkline* pSparkline,
+//			    int x, int width, int nPages )
+//	Copy column x of the sparkline to the rows below the title of the
+//	page that starts at pPage in a display buffer.
+//------------------------------------------------------------------------------
+static void copyColumn( uint8_t* pPage, const Sparkline* pSparkline, int x,
+			int width, int nPages )
+{
+    int page;
+
+    for ( page = 0; page < nPages; page++ )
+    {
+	pPage[ (page + 1) * width + x ] = pSparkline->buffer[ page * width + x ];
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void drawSparkline( ssd1306_ctx* pCanvas, uint8_t* pPage,
+//			       SparklinePage* pState,
+//			       const Sparkline* pSparkline,
+//			       const DisplaySnapshot* pSnapshot )
+//	Update the sparkline page pState at pPage, the first page row of it in
+//	a display buffer: the current temperature with the range of the
+//	sparkline on the top line, which is drawn on pCanvas and only when one
+//	of them changed, and the columns of the sparkline below it that
+//	changed since the previous call. All of the page is drawn if pState is
+//	not valid. pPage can be the buffer of pCanvas itself.
+//------------------------------------------------------------------------------
+static void drawSparkline( ssd1306_ctx* pCanvas, uint8_t* pPage,
+			   SparklinePage* pState, const Sparkline* pSparkline,
+			   const DisplaySnapshot* pSnapshot )
+{
+    DisplayLine* pTitle = &pState->title;
+    int		width = pCanvas->width;
+    int		nPages = pCanvas->height / 8 - 1;
+    uint64_t	next = pSparkline->nextRecord;
+    int		newest = (next + width - 1) % width;
+    int		first;
+    int		minValue = INT16_MAX;
+    int		maxValue = INT16_MIN;
+    long long	range = SPARKLINE_NO_RANGE;
+    uint64_t	r;
+    int		i;
+
+    if ( nPages > SPARKLINE_PAGES )
+    {
+	nPages = SPARKLINE_PAGES;
+    }
+
+    if ( !pState->bValid )
+    {
+	// Start a new frame
+	ssd1306_clearDisplay( pCanvas );
+	pTitle->value = DISPLAY_NO_VALUE;
+	pTitle->length = 0;
+	pTitle->text[ 0 ] = '\0';
+	pState->drawnRecord = 0;
+	pState->bValid = true;
+	if ( pPage != pCanvas->buffer )
+	{
+	    memset( pPage, 0, width );
+	}
+	for ( i = 0; i < width && nPages > 0; i++ )
+	{
+	    copyColumn( pPage, pSparkline, i, width, nPages );
+	}
+    }
+    else if ( nPages > 0 && next != pState->drawnRecord )
+    {
+	// The columns of the new records and the gap after the newest
+	r = (next - pState->drawnRecord > (uint64_t)width) ? next - width
+							   : pState->drawnRecord;
+	for ( ; r < next; r++ )
+	{
+	    copyColumn( pPage, pSparkline, r % width, width, nPages );
+	}
+	copyColumn( pPage, pSparkline, (newest + 1) % width, width, nPages );
+    }
+    pState->drawnRecord = next;
+
+    // The columns of the last nValues samples may wrap around
+    first = newest - pSparkline->nValues + 1;
+    for ( i = 0; i < width; i++ )
+    {
+	int value = pSparkline->values[ i ];
+	bool bSample = (first >= 0) ? (i >= first && i <= newest)
+				    : (i <= newest || i >= first + width);
+
+	if ( bSample && value != HISTORY_NO_VALUE )
+	{
+	    minValue = (value < minValue) ? value : minValue;
+	    maxValue = (value > maxValue) ? value : maxValue;
+	}
+    }
+
+    // Whole degrees of the range, 10 bits each, below the tenths of the
+    // temperature in one value
+    if ( minValue <= maxValue )
+    {
+	range = (((minValue + 50) / 100 + SPARKLINE_RANGE_OFFSET) << 10) |
+		((maxValue + 50) / 100 + SPARKLINE_RANGE_OFFSET);
+    }
+    if ( !lineUpToDate( pTitle, tenthsOf( pSnapshot->temperature ) *
+				SPARKLINE_RANGE_SCALE + range ))
+    {
+	int n = appendText( pTitle->text, 0, "Temp:" );
+
+	n = appendNumber( pTitle->text, n,
+			  tenthsOf( pSnapshot->temperature ), 1 );
+	n = appendText( pTitle->text, n, "C" );
+	if ( range != SPARKLINE_NO_RANGE )
+	{
+	    n = appendText( pTitle->text, n, " " );
+	    n = appendNumber( pTitle->text, n, (minValue + 50) / 100, 0 );
+	    n = appendText( pTitle->text, n, "-" );
+	    n = appendNumber( pTitle->text, n, (maxValue + 50) / 100, 0 );
+	    appendText( pTitle->text, n, "C" );
+	}
+	drawLineAt( pCanvas, &gTitlePosition, pTitle, pTitle->text );
+	if ( pPage != pCanvas->buffer )
+	{
+	    memcpy( pPage, pCanvas->buffer, width );
+	}
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  int displayRenderSparkline( ssd1306_ctx* pDisplay, SparklinePage* pState,
+//				const Sparkline* pSparkline,
+//				const DisplaySnapshot* pSnapshot )
+//	Update the sparkline page, see drawSparkline, and transfer what
+//	changed to the display.
+//	Returns 0 if the page was displayed successfully; -1 otherwise
+//------------------------------------------------------------------------------
+int displayRenderSparkline( ssd1306_ctx* pDisplay, SparklinePage* pState,
+			    const Sparkline* pSparkline,
+			    const DisplaySnapshot* pSnapshot )
+{
+    drawSparkline( pDisplay, pDisplay->buffer, pState, pSparkline, pSnapshot );
+    return ssd1306_display( pDisplay );
+}
+
+
+//------------------------------------------------------------------------------
+//  static int renderSparklineBelow( DisplayWorker* pWorker,
+//				     const DisplaySnapshot* pSnapshot )
+//	Update the sparkline page in the display buffer below the text page,
+//	with the title drawn on the canvas, and transfer what changed.
+//	Returns 0 if the page was displayed successfully; -1 otherwise
+//------------------------------------------------------------------------------
+static int renderSparklineBelow( DisplayWorker* pWorker,
+				 const DisplaySnapshot* pSnapshot )
+{
+    ssd1306_ctx*	pDisplay = pWorker->pDisplay;
+    int			size = pDisplay->width * pDisplay->height / 8;
+
+    drawSparkline( &pWorker->canvas, pDisplay->buffer + size,
+		   &pWorker->sparklinePage, &pWorker->sparkline, pSnapshot );
+    return ssd1306_display( pDisplay );
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool displayPower( DisplayWorker* pWorker,
+//			      const DisplaySnapshot* pSnapshot )
+//	Dim the display in the configured hours, and switch it off or on
+//	again according to the time since the last band change.
+//	Returns whether the display is on
+//------------------------------------------------------------------------------
+static bool displayPower( DisplayWorker* pWorker,
+			  const DisplaySnapshot* pSnapshot )
+{
+    int		from = pSnapshot->dimFromHour;
+    int		to = pSnapshot->dimToHour;
+    long long	nowMs = schedNowMs();
+    bool	bDim = false;
+    bool	bBlank;
+
+    if ( from != to )
+    {
+	time_t		now = time( NULL );
+	struct tm	local;
+
+	if ( localtime_r( &now, &local ) != NULL )
+	{
+	    // The hours may wrap around midnight
+	    bDim = (from < to) ? (local.tm_hour >= from && local.tm_hour < to)
+			       : (local.tm_hour >= from || local.tm_hour < to);
+	}
+    }
+    if ( bDim != pWorker->bDimmed )
+    {
+	ssd1306_dim( pWorker->pDisplay, bDim );
+	pWorker->bDimmed = bDim;
+    }
+
+    if ( pSnapshot->bandChanges != pWorker->bandChanges )
+    {
+	pWorker->bandChanges = pSnapshot->bandChanges;
+	pWorker->changeMs = nowMs;
+    }
+    bBlank = pSnapshot->blankMs > 0 &&
+	     nowMs - pWorker->changeMs >= pSnapshot->blankMs;
+    if ( bBlank != pWorker->bBlanked )
+    {
+	ssd1306_sleep( pWorker->pDisplay, bBlank );
+	pWorker->bBlanked = bBlank;
+    }
+    return !bBlank;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void* displayThread( void* pArg )
+//	Worker: render every snapshot that is published until stopped, on
+//	the text page or the sparkline page in turn.
+//------------------------------------------------------------------------------
+static void* displayThread( void* pArg )
+{
+    DisplayWorker* pWorker = pArg;
+
+    while ( !atomic_load( &pWorker->bStop ))
+    {
+	bool 			bFresh;
+	bool			bText;
+	const DisplaySnapshot*	pSnapshot;
+
+	if ( mailboxWait( &pWorker->mailbox, -1 ) < 0 )
+	{
+	    continue;	// interrupted
+	}
+
+	pSnapshot = mailboxLatest( &pWorker->mailbox, &bFresh );
+	if ( !bFresh || atomic_load( &pWorker->bStop ))
+	{
+	    continue;
+	}
+
+	// Nothing to draw while the display is off
+	if ( !displayPower( pWorker, pSnapshot ))
+	{
+	    continue;
+	}
+
+	if ( pWorker->pHistory == NULL )
+	{
+	    displayRender( pWorker->pDisplay, &pWorker->text, pSnapshot );
+	    continue;
+	}
+
+	// Follow the history on both pages, so adding a sample stays cheap
+	sparklineUpdate( &pWorker->sparkline, pWorker->pHistory,
+			 pWorker->pDisplay->width, pWorker->pDisplay->height );
+	bText = (pWorker->frame++ / DISPLAY_PAGE_FRAMES) % 2 == 0;
+	if ( bText )
+	{
+	    displayRender( pWorker->pDisplay, &pWorker->text, pSnapshot );
+	    if ( !pWorker->bFlip )
+	    {
+		pWorker->sparklinePage.bValid = false;	// drawn over
+	    }
+	}
+	else if ( pWorker->bFlip )
+	{
+	    renderSparklineBelow( pWorker, pSnapshot );
+	}
+	else
+	{
+	    displayRenderSparkline( pWorker->pDisplay, &pWorker->sparklinePage,
+				    &pWorker->sparkline, pSnapshot );
+	    pWorker->text.bValid = false;	// drawn over
+	}
+
+	// Turn to the page after it was brought up to date
+	if ( pWorker->bFlip )
+	{
+	    ssd1306_setStartLine( pWorker->pDisplay,
+				  bText ? 0 : pWorker->pDisplay->height );
+	}
+    }
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  int displayStart( DisplayWorker* pWorker, ssd1306_ctx* pDisplay,
+//		      const History* pHistory )
+//	Start the worker thread for pDisplay, which is only accessed by the
+//	worker until displayStop. The sparkline page shows pHistory; without
+//	a history (NULL) only the text page is shown.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int displayStart( DisplayWorker* pWorker, ssd1306_ctx* pDisplay,
+		  const History* pHistory )
+{
+    pWorker->pDisplay = pDisplay;
+    pWorker->pHistory = pHistory;
+    memset( &pWorker->sparkline, 0, sizeof( pWorker->sparkline ));
+    pWorker->text.bValid = false;
+    pWorker->sparklinePage.bValid = false;
+    pWorker->frame = 0;
+    pWorker->bandChanges = 0;
+    pWorker->changeMs = schedNowMs();
+    pWorker->bDimmed = false;
+    pWorker->bBlanked = false;
+
+    // Keep the sparkline page in display RAM below the text page, if the
+    // panel leaves room for it
+    pWorker->bFlip = pHistory != NULL &&
+		     ssd1306_setRamHeight( pDisplay, 2 * pDisplay->height ) == 0;
+    if ( pWorker->bFlip )
+    {
+	ssd1306_init( &pWorker->canvas, pDisplay->width, pDisplay->height );
+    }
+    pWorker->bStarted = false;
+    atomic_init( &pWorker->bStop, false );
+
+    if ( mailboxInit( &pWorker->mailbox, sizeof( DisplaySnapshot )) != 0 )
+    {
+	return -1;
+    }
+
+    if ( pthread_create( &pWorker->thread, NULL, displayThread, pWorker ) != 0 )
+    {
+	fprintf( stderr, "Could not start display thread\n" );
+	mailboxClose( &pWorker->mailbox );
+	return -1;
+    }
+    pWorker->bStarted = true;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  DisplaySnapshot* displaySnapshot( DisplayWorker* pWorker )
+//	Returns the snapshot to fill before displayPublish. It does not hold
+//	the previous values, so all fields have to be set.
+//------------------------------------------------------------------------------
+DisplaySnapshot* displaySnapshot( DisplayWorker* pWorker )
+{
+    return mailboxBack( &pWorker->mailbox );
+}
+
+
+//------------------------------------------------------------------------------
+//  void displayPublish( DisplayWorker* pWorker )
+//	Hand the filled snapshot to the worker. Never blocks; a snapshot the
+//	worker did not get to yet is replaced.
+//------------------------------------------------------------------------------
+void displayPublish( DisplayWorker* pWorker )
+{
+    mailboxPublish( &pWorker->mailbox );
+}
+
+
+//------------------------------------------------------------------------------
+//  void displayStop( DisplayWorker* pWorker )
+//	Stop the worker after the page it is drawing, and wait for it. The
+//	display is left showing the text page.
+//------------------------------------------------------------------------------
+void displayStop( DisplayWorker* pWorker )
+{
+    if ( !pWorker->bStarted )
+    {
+	return;
+    }
+
+    atomic_store( &pWorker->bStop, true );
+    mailboxPublish( &pWorker->mailbox );	// wake the worker
+    pthread_join( pWorker->thread, NULL );
+    mailboxClose( &pWorker->mailbox );
+    if ( pWorker->bFlip )
+    {
+	ssd1306_setStartLine( pWorker->pDisplay, 0 );
+	ssd1306_setRamHeight( pWorker->pDisplay, pWorker->pDisplay->height );
+    }
+    pWorker->bStarted = false;
+}
@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+//  File: 	display.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  OLED display page of the temperature control daemon. The control loop
+//  fills a DisplaySnapshot with its state and publishes it; a worker thread
+//  draws the latest snapshot and transfers it to the display, so the control
+//  loop never waits for the display.
+//
+//  The text page shows the temperature in the size 2 font, with the CPU
+//  and RAM utilization to the right of it and the disk space and IP address
+//  below. It is kept in the display buffer between frames: each line
+//  remembers the value it was formatted from, and is only formatted and
+//  drawn again when that value changed. The display transfers only the
+//  columns that changed, so a frame without changes costs no formatting,
+//  drawing or I2C transfer at all.
+//
+//  The worker alternates between the text page and a page with a sparkline
+//  of the last samples of the history (history.h), one column per sample.
+//  The sparkline is kept up to date incrementally: each new sample is drawn
+//  in the column after the previous one, wrapping around at the right edge
+//  with a blank column ahead of the newest sample, so only two columns of
+//  the page change. Its title line is cached like the lines of the text
+//  page.
+//
+//  On a panel of at most 32 rows both pages fit in the 64 rows of display
+//  RAM: the text page in the rows of the panel and the sparkline page below
+//  it. Only the page that is shown is updated, and turning to the other
+//  page is a single start line command, so the rotation itself transfers no
+//  picture data. Taller panels redraw each page when it is turned to.
+//
+//  To save power and burn-in, the display is dimmed between the hours of
+//  the config file, and switched off when the band has not changed for the
+//  configured time; the next band change switches it on again.
+//
+//------------------------------------------------------------------------------
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ssd1306_i2c.h"
+#include "mailbox.h"
+#include "metrics.h"
+#include "history.h"
+
+#define DISPLAY_PAGE_FRAMES	3	// frames each page is shown
+#define DISPLAY_TEXT_SIZE 	32
+#define SPARKLINE_MIN		30.0	// temperature at the bottom, Celsius
+#define SPARKLINE_MAX		78.0	// temperature at the top
+#define SPARKLINE_PAGES 	(SSD1306_MAXHEIGHT / 8 - 1)	// below the title
+
+// State of the control loop that is shown on the display
+typedef struct DisplaySnapshot
+{
+    double	temperature;	// control temperature, degrees Celsius
+    double	cpuBusy;	// utilization of all cores, percent
+    bool	bThrottled;	// the firmware limits the ARM clock
+    char	diskInfoTxt	[ METRICS_TEXT_SIZE ];
+    char	ipInfoTxt	[ METRICS_TEXT_SIZE ];
+    unsigned long bandChanges;	// range transitions, wake the display
+
+    // Power saving, see FanPolicy
+    int		dimFromHour;
+    int		dimToHour;
+    int		blankMs;
+} DisplaySnapshot;
+
+// Lines of the text page
+typedef enum DisplayLineId
+{
+    DisplayLineCpu =		0,
+    DisplayLineTemperature =	1,
+    DisplayLineRam =		2,
+    DisplayLineThrottle =	3,
+    DisplayLineDisk =		4,
+    DisplayLineIp =		5,
+    DISPLAY_NUM_LINES =		6
+} DisplayLineId;
+
+typedef struct DisplayLine
+{
+    long long	value;		// value the text was formatted from
+    int		length;		// characters drawn
+    char	text	[ DISPLAY_TEXT_SIZE ];
+} DisplayLine;
+
+// Text page as drawn in the display buffer
+typedef struct DisplayText
+{
+    bool	bValid;		// false after something else was drawn
+    DisplayLine	lines	[ DISPLAY_NUM_LINES ];
+} DisplayText;
+
+// Sparkline page as drawn in the display buffer
+typedef struct SparklinePage
+{
+    bool	bValid;		// false after something else was drawn
+    uint64_t	drawnRecord;	// records of the sparkline drawn before
+    DisplayLine	title;		// temperature and range of the sparkline
+} SparklinePage;
+
+// Sparkline of the last samples, in the page layout of the display buffer
+typedef struct Sparkline
+{
+    uint8_t	buffer	[ SPARKLINE_PAGES * SSD1306_MAXWIDTH ];
+    int16_t	values	[ SSD1306_MAXWIDTH ];	// per column
+    int		nValues;
+    uint64_t	nextRecord;			// next history record to add
+} Sparkline;
+
+typedef struct DisplayWorker
+{
+    ssd1306_ctx*	pDisplay;
+    const History*	pHistory;	// source of the sparkline, or NULL
+    DisplayText		text;
+    SparklinePage	sparklinePage;
+    Sparkline		sparkline;
+    ssd1306_ctx		canvas;		// sparkline page for below the text page
+    bool		bFlip;		// both pages in display RAM
+    int			frame;
+    unsigned long	bandChanges;	// of the last snapshot
+    long long		changeMs;	// last band change, or start
+    bool		bDimmed;
+    bool		bBlanked;
+    Mailbox		mailbox;
+    pthread_t		thread;
+    atomic_bool		bStop;
+    bool		bStarted;
+} DisplayWorker;
+
+int		displayRender( ssd1306_ctx* pDisplay, DisplayText* pText,
+			       const DisplaySnapshot* pSnapshot );
+int		displayRenderSparkline( ssd1306_ctx* pDisplay,
+					    SparklinePage* pState,
+					    const Sparkline* pSparkline,
+					    const DisplaySnapshot* pSnapshot );
+void		sparklineUpdate( Sparkline* pSparkline, const History* pHistory,
+				 int width, int height );
+int		displayStart( DisplayWorker* pWorker, ssd1306_ctx* pDisplay,
+			      const History* pHistory );
+DisplaySnapshot* displaySnapshot( DisplayWorker* pWorker );
+void		displayPublish( DisplayWorker* pWorker );
+void		displayStop( DisplayWorker* pWorker );
+
+#endif
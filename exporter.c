@@ -0,0 +1,598 @@
+//------------------------------------------------------------------------------
+//  File: 	exporter.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Prometheus exporter, see exporter.h.
+//
+//  All sockets are non-blocking and served from one epoll loop. A client
+//  sends one request; the complete response is formatted from the latest
+//  snapshot and handed to the socket in one call, after which the
+//  connection is closed. A response is a few KB and always fits the send
+//  buffer of a fresh socket. Clients that do not send a request in time are
+//  dropped, and connections beyond EXPORTER_MAX_CLIENTS are refused, so a
+//  scrape storm only costs the exporter thread.
+//
+//------------------------------------------------------------------------------
+#define _GNU_SOURCE		// accept4()
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "exporter.h"
+
+#define EXPORTER_RESPONSE_SIZE	8192
+
+// Upper bounds of the histogram buckets, seconds
+static const double gBucketBounds[ EXPORTER_BUCKETS ] =
+{
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.05
+};
+
+
+//------------------------------------------------------------------------------
+//  void exporterObserve( ExporterHistogram* pHistogram, double seconds )
+//	Count a duration in its histogram bucket.
+//------------------------------------------------------------------------------
+void exporterObserve( ExporterHistogram* pHistogram, double seconds )
+{
+    int bucket = 0;
+
+    while ( bucket < EXPORTER_BUCKETS && seconds > gBucketBounds[ bucket ] )
+    {
+	bucket++;
+    }
+    pHistogram->counts[ bucket ]++;
+    pHistogram->count++;
+    pHistogram->sum += seconds;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void append( char* pBuffer, int* pLength, const char* pFormat, ... )
+//	Append formatted text to a response of EXPORTER_RESPONSE_SIZE bytes;
+//	text that does not fit is dropped.
+//------------------------------------------------------------------------------
+static void append( char* pBuffer, int* pLength, const char* pFormat, ... )
+{
+    va_list	args;
+    int		n;
+
+    if ( *pLength >= EXPORTER_RESPONSE_SIZE - 1 )
+    {
+	return;
+    }
+
+    va_start( args, pFormat );
+    n = vsnprintf( pBuffer + *pLength, EXPORTER_RESPONSE_SIZE - *pLength,
+		   pFormat, args );
+    va_end( args );
+
+    if ( n > 0 )
+    {
+	*pLength += n;
+	if ( *pLength > EXPORTER_RESPONSE_SIZE - 1 )
+	{
+	    *pLength = EXPORTER_RESPONSE_SIZE - 1;
+	}
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void appendMetric( char* pBuffer, int* pLength, const char* pName,
+//			      const char* pType, const char* pHelp )
+//	Append the HELP and TYPE lines of a metric.
+//------------------------------------------------------------------------------
+static void appendMetric( char* pBuffer, int* pLength, const char* pName,
+			  const char* pType, const char* pHelp )
+{
+    append( pBuffer, pLength, "# HELP %s %s\n# TYPE %s %s\n", pName, pHelp,
+	    pName, pType );
+}
+
+
+//------------------------------------------------------------------------------
+//  static void appendHistogram( char* pBuffer, int* pLength,
+//				 const char* pName, const char* pHelp,
+//				 const ExporterHistogram* pHistogram )
+//	Append a histogram, with cumulative buckets.
+//------------------------------------------------------------------------------
+static void appendHistogram( char* pBuffer, int* pLength, const char* pName,
+			     const char* pHelp,
+			     const ExporterHistogram* pHistogram )
+{
+    unsigned long	cumulative = 0;
+    int			i;
+
+    appendMetric( pBuffer, pLength, pName, "histogram", pHelp );
+    for ( i = 0; i < EXPORTER_BUCKETS; i++ )
+    {
+	cumulative += pHistogram->counts[ i ];
+	append( pBuffer, pLength, "%s_bucket{le=\"%g\"} %lu\n", pName,
+		gBucketBounds[ i ], cumulative );
+    }
+    append( pBuffer, pLength, "%s_bucket{le=\"+Inf\"} %lu\n", pName,
+	    pHistogram->count );
+    append( pBuffer, pLength, "%s_sum %.6f\n%s_count %lu\n", pName,
+	    pHistogram->sum, pName, pHistogram->count );
+}
+
+
+//------------------------------------------------------------------------------
+//  static int formatMetrics( const Exporter* pExporter,
+//			      const ExporterSnapshot* pSnapshot, char* pBuffer )
+//	Format the snapshot in the Prometheus text format.
+//	Returns the length of the text
+//------------------------------------------------------------------------------
+static int formatMetrics( const Exporter* pExporter,
+			  const ExporterSnapshot* pSnapshot, char* pBuffer )
+{
+    int length = 0;
+    int i;
+
+    appendMetric( pBuffer, &length, "tempcontrol_temperature_celsius", "gauge",
+		  "Control temperature of all zones." );
+    append( pBuffer, &length, "tempcontrol_temperature_celsius %.3f\n",
+	    pSnapshot->temperature );
+
+    appendMetric( pBuffer, &length, "tempcontrol_predicted_temperature_celsius",
+		  "gauge", "Predicted temperature of the range selection, "
+		  "the control temperature in PID mode." );
+    append( pBuffer, &length, "tempcontrol_predicted_temperature_celsius %.3f\n",
+	    pSnapshot->predictedTemperature );
+
+    appendMetric( pBuffer, &length, "tempcontrol_zone_temperature_celsius",
+		  "gauge", "Temperature of a thermal zone or hwmon input." );
+    for ( i = 0; i < pSnapshot->nZones; i++ )
+    {
+	if ( pSnapshot->zoneValid[ i ] )
+	{
+	    append( pBuffer, &length,
+		    "tempcontrol_zone_temperature_celsius{zone=\"%s\"} %.3f\n",
+		    pSnapshot->zoneNames[ i ],
+		    pSnapshot->zoneTemperatures[ i ] );
+	}
+    }
+
+    if ( pSnapshot->nCpus >= 0 )
+    {
+	appendMetric( pBuffer, &length, "tempcontrol_cpu_busy_percent", "gauge",
+		      "CPU utilization over the last sample period." );
+	append( pBuffer, &length, "tempcontrol_cpu_busy_percent{cpu=\"all\"} "
+		"%.1f\n", pSnapshot->cpuBusy[ 0 ] );
+	for ( i = 0; i < pSnapshot->nCpus; i++ )
+	{
+	    append( pBuffer, &length, "tempcontrol_cpu_busy_percent{cpu=\"%d\"} "
+		    "%.1f\n", i, pSnapshot->cpuBusy[ i + 1 ] );
+	}
+    }
+
+    if ( pSnapshot->bThrottleValid )
+    {
+	static const char* pFlagNames[ THROTTLE_NUM_FLAGS ] =
+	{
+	    "undervoltage", "freq_capped", "throttled", "soft_temp_limit"
+	};
+
+	appendMetric( pBuffer, &length, "tempcontrol_throttle_flags", "gauge",
+		      "Firmware get_throttled flags." );
+	append( pBuffer, &length, "tempcontrol_throttle_flags %u\n",
+		pSnapshot->throttleFlags );
+
+	appendMetric( pBuffer, &length, "tempcontrol_throttle_active", "gauge",
+		      "Whether a throttle condition is active now." );
+	for ( i = 0; i < THROTTLE_NUM_FLAGS; i++ )
+	{
+	    append( pBuffer, &length,
+		    "tempcontrol_throttle_active{condition=\"%s\"} %d\n",
+		    pFlagNames[ i ],
+		    (pSnapshot->throttleFlags >> i) & 1 );
+	}
+
+	appendMetric( pBuffer, &length, "tempcontrol_throttle_events_total",
+		      "counter", "Times a throttle condition became active." );
+	for ( i = 0; i < THROTTLE_NUM_FLAGS; i++ )
+	{
+	    append( pBuffer, &length,
+		    "tempcontrol_throttle_events_total{condition=\"%s\"} %lu\n",
+		    pFlagNames[ i ], pSnapshot->throttleCounts[ i ] );
+	}
+    }
+
+    if ( pSnapshot->armFreqKHz > 0 )
+    {
+	appendMetric( pBuffer, &length, "tempcontrol_arm_frequency_hertz",
+		      "gauge", "Current ARM clock." );
+	append( pBuffer, &length, "tempcontrol_arm_frequency_hertz %ld000\n",
+		pSnapshot->armFreqKHz );
+    }
+
+    appendMetric( pBuffer, &length, "tempcontrol_fan_register", "gauge",
+		  "Fan register of the cooling hat (0 off, 1 full, 2..9)." );
+    append( pBuffer, &length, "tempcontrol_fan_register %d\n",
+	    pSnapshot->fanValue );
+
+    appendMetric( pBuffer, &length, "tempcontrol_range", "gauge",
+		  "Index of the temperature range that is applied." );
+    append( pBuffer, &length, "tempcontrol_range %d\n", pSnapshot->band );
+
+    appendMetric( pBuffer, &length, "tempcontrol_range_changes_total",
+		  "counter", "Transitions between temperature ranges." );
+    append( pBuffer, &length, "tempcontrol_range_changes_total %lu\n",
+	    pSnapshot->bandChanges );
+
+    appendMetric( pBuffer, &length, "tempcontrol_hat_writes_total", "counter",
+		  "Register writes to the cooling hat." );
+    append( pBuffer, &length, "tempcontrol_hat_writes_total %lu\n",
+	    pSnapshot->hatTransfers );
+
+    appendMetric( pBuffer, &length, "tempcontrol_i2c_transfers_total",
+		  "counter", "I2C transfers of all devices on the bus." );
+    append( pBuffer, &length, "tempcontrol_i2c_transfers_total %lu\n",
+	    pSnapshot->i2cTransfers );
+
+    appendMetric( pBuffer, &length, "tempcontrol_i2c_errors_total", "counter",
+		  "Failed I2C transfers." );
+    append( pBuffer, &length, "tempcontrol_i2c_errors_total %lu\n",
+	    pSnapshot->i2cErrors );
+
+    appendHistogram( pBuffer, &length, "tempcontrol_sample_duration_seconds",
+		     "Run time of the sample task.",
+		     &pSnapshot->sampleDuration );
+    appendHistogram( pBuffer, &length, "tempcontrol_sample_lateness_seconds",
+		     "Start of the sample task after its period.",
+		     &pSnapshot->sampleLateness );
+
+    appendMetric( pBuffer, &length, "tempcontrol_scrapes_total", "counter",
+		  "Requests served by the exporter." );
+    append( pBuffer, &length, "tempcontrol_scrapes_total %lu\n",
+	    pExporter->nScrapes );
+
+    return length;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void closeClient( ExporterClient* pClient )
+//	Stop serving a client and free its slot.
+//------------------------------------------------------------------------------
+static void closeClient( ExporterClient* pClient )
+{
+    schedRemoveFd( &pClient->pExporter->sched, pClient->fd );
+    close( pClient->fd );
+    pClient->fd = -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void respond( ExporterClient* pClient )
+//	Send the response to the request of a client.
+//------------------------------------------------------------------------------
+static void respond( ExporterClient* pClient )
+{
+    Exporter*			pExporter = pClient->pExporter;
+    const ExporterSnapshot*	pSnapshot;
+    char			header	[ 160 ];
+    char			body	[ EXPORTER_RESPONSE_SIZE ];
+    const char*			pStatus = "200 OK";
+    struct iovec		parts	[ 2 ];
+    struct msghdr		message;
+    int				bodyLength = 0;
+
+    if ( strncmp( pClient->request, "GET /metrics ", 13 ) != 0 &&
+	 strncmp( pClient->request, "GET / ", 6 ) != 0 )
+    {
+	pStatus = "404 Not Found";
+    }
+    else if ( (pSnapshot = mailboxLatest( &pExporter->mailbox, NULL )) == NULL )
+    {
+	pStatus = "503 Service Unavailable";
+    }
+    else
+    {
+	pExporter->nScrapes++;
+	bodyLength = formatMetrics( pExporter, pSnapshot, body );
+    }
+
+    parts[ 0 ].iov_base = header;
+    parts[ 0 ].iov_len = snprintf( header, sizeof( header ),
+				   "HTTP/1.0 %s\r\n"
+				   "Content-Type: text/plain; version=0.0.4\r\n"
+				   "Content-Length: %d\r\n"
+				   "Connection: close\r\n\r\n",
+				   pStatus, bodyLength );
+    parts[ 1 ].iov_base = body;
+    parts[ 1 ].iov_len = bodyLength;
+
+    memset( &message, 0, sizeof( message ));
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    if ( sendmsg( pClient->fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL ) < 0 )
+    {
+	// Client gone; nothing to do but close
+    }
+    closeClient( pClient );
+}
+
+
+//------------------------------------------------------------------------------
+//  static void onClient( void* pArg )
+//	Scheduler task: read the request of a client, and respond once the
+//	request header is complete.
+//------------------------------------------------------------------------------
+static void onClient( void* pArg )
+{
+    ExporterClient* 	pClient = pArg;
+    ssize_t		n = recv( pClient->fd, pClient->request + pClient->length,
+				  EXPORTER_REQUEST_SIZE - 1 - pClient->length,
+				  MSG_DONTWAIT );
+
+    if ( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) )
+    {
+	return;
+    }
+    if ( n <= 0 )
+    {
+	closeClient( pClient );
+	return;
+    }
+
+    pClient->length += n;
+    pClient->request[ pClient->length ] = '\0';
+    if ( strstr( pClient->request, "\r\n\r\n" ) != NULL ||
+	 strstr( pClient->request, "\n\n" ) != NULL ||
+	 pClient->length == EXPORTER_REQUEST_SIZE - 1 )
+    {
+	respond( pClient );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void onAccept( void* pArg )
+//	Scheduler task: accept new connections, as long as there are free
+//	client slots.
+//------------------------------------------------------------------------------
+static void onAccept( void* pArg )
+{
+    Exporter* 	pExporter = pArg;
+    int		fd;
+
+    while ( (fd = accept4( pExporter->listenFd, NULL, NULL,
+			   SOCK_NONBLOCK | SOCK_CLOEXEC )) >= 0 )
+    {
+	ExporterClient*	pClient = NULL;
+	int		i;
+
+	for ( i = 0; i < EXPORTER_MAX_CLIENTS && pClient == NULL; i++ )
+	{
+	    if ( pExporter->clients[ i ].fd < 0 )
+	    {
+		pClient = &pExporter->clients[ i ];
+	    }
+	}
+
+	if ( pClient == NULL )
+	{
+	    close( fd );	// busy
+	    continue;
+	}
+
+	pClient->fd = fd;
+	pClient->acceptedMs = schedNowMs();
+	pClient->length = 0;
+	if ( schedAddFd( &pExporter->sched, fd, onClient, pClient ) != 0 )
+	{
+	    close( fd );
+	    pClient->fd = -1;
+	}
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void onTimeoutTimer( void* pArg )
+//	Scheduler task: drop clients that did not send a request in time.
+//------------------------------------------------------------------------------
+static void onTimeoutTimer( void* pArg )
+{
+    Exporter* 	pExporter = pArg;
+    long long	nowMs = schedNowMs();
+    int		i;
+
+    for ( i = 0; i < EXPORTER_MAX_CLIENTS; i++ )
+    {
+	ExporterClient* pClient = &pExporter->clients[ i ];
+
+	if ( pClient->fd >= 0 &&
+	     nowMs - pClient->acceptedMs > EXPORTER_TIMEOUT_MS )
+	{
+	    closeClient( pClient );
+	}
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void onStop( void* pArg )
+//	Scheduler task: exporterStop was called.
+//------------------------------------------------------------------------------
+static void onStop( void* pArg )
+{
+    Exporter*	pExporter = pArg;
+    uint64_t	count;
+
+    if ( read( pExporter->stopFd, &count, sizeof( count )) == sizeof( count ))
+    {
+	schedStop( &pExporter->sched );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void* exporterThread( void* pArg )
+//	Exporter thread: serve requests until stopped.
+//------------------------------------------------------------------------------
+static void* exporterThread( void* pArg )
+{
+    Exporter* pExporter = pArg;
+
+    schedRun( &pExporter->sched );
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void exporterRelease( Exporter* pExporter )
+//	Close the sockets, the scheduler and the mailbox.
+//------------------------------------------------------------------------------
+static void exporterRelease( Exporter* pExporter )
+{
+    int i;
+
+    for ( i = 0; i < EXPORTER_MAX_CLIENTS; i++ )
+    {
+	if ( pExporter->clients[ i ].fd >= 0 )
+	{
+	    close( pExporter->clients[ i ].fd );
+	    pExporter->clients[ i ].fd = -1;
+	}
+    }
+    schedClose( &pExporter->sched );
+    if ( pExporter->listenFd >= 0 )
+    {
+	close( pExporter->listenFd );
+	pExporter->listenFd = -1;
+    }
+    if ( pExporter->stopFd >= 0 )
+    {
+	close( pExporter->stopFd );
+	pExporter->stopFd = -1;
+    }
+    mailboxClose( &pExporter->mailbox );
+}
+
+
+//------------------------------------------------------------------------------
+//  int exporterStart( Exporter* pExporter, int port )
+//	Listen on TCP port on all addresses and start the exporter thread.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int exporterStart( Exporter* pExporter, int port )
+{
+    struct sockaddr_in	address;
+    int			one = 1;
+    int			i;
+
+    memset( pExporter, 0, sizeof( *pExporter ));
+    pExporter->listenFd = -1;
+    pExporter->stopFd = -1;
+    pExporter->sched.epollFd = -1;
+    for ( i = 0; i < EXPORTER_MAX_CLIENTS; i++ )
+    {
+	pExporter->clients[ i ].pExporter = pExporter;
+	pExporter->clients[ i ].fd = -1;
+    }
+
+    if ( mailboxInit( &pExporter->mailbox, sizeof( ExporterSnapshot )) != 0 )
+    {
+	return -1;
+    }
+
+    memset( &address, 0, sizeof( address ));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port = htons( port );
+
+    pExporter->listenFd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK |
+				  SOCK_CLOEXEC, 0 );
+    if ( pExporter->listenFd < 0 ||
+	 setsockopt( pExporter->listenFd, SOL_SOCKET, SO_REUSEADDR, &one,
+		     sizeof( one )) != 0 ||
+	 bind( pExporter->listenFd, (struct sockaddr*)&address,
+	       sizeof( address )) != 0 ||
+	 listen( pExporter->listenFd, EXPORTER_MAX_CLIENTS ) != 0 )
+    {
+	fprintf( stderr, "Could not listen on port %d\n", port );
+	exporterRelease( pExporter );
+	return -1;
+    }
+
+    pExporter->stopFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( pExporter->stopFd < 0 ||
+	 schedInit( &pExporter->sched ) != 0 ||
+	 schedAddFd( &pExporter->sched, pExporter->listenFd, onAccept,
+		     pExporter ) != 0 ||
+	 schedAddFd( &pExporter->sched, pExporter->stopFd, onStop,
+		     pExporter ) != 0 ||
+	 schedAddTimer( &pExporter->sched, EXPORTER_TIMEOUT_MS / 2,
+			onTimeoutTimer, pExporter ) < 0 )
+    {
+	exporterRelease( pExporter );
+	return -1;
+    }
+
+    if ( pthread_create( &pExporter->thread, NULL, exporterThread,
+			 pExporter ) != 0 )
+    {
+	fprintf( stderr, "Could not start exporter thread\n" );
+	exporterRelease( pExporter );
+	return -1;
+    }
+    pExporter->bStarted = true;
+    fprintf( stderr, "Exporting metrics on port %d\n", port );
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  ExporterSnapshot* exporterSnapshot( Exporter* pExporter )
+//	Returns the snapshot to fill before exporterPublish. It does not hold
+//	the previous values, so all fields have to be set.
+//------------------------------------------------------------------------------
+ExporterSnapshot* exporterSnapshot( Exporter* pExporter )
+{
+    return mailboxBack( &pExporter->mailbox );
+}
+
+
+//------------------------------------------------------------------------------
+//  void exporterPublish( Exporter* pExporter )
+//	Make the filled snapshot the one that is served. Never blocks.
+//------------------------------------------------------------------------------
+void exporterPublish( Exporter* pExporter )
+{
+    mailboxPublish( &pExporter->mailbox );
+}
+
+
+//------------------------------------------------------------------------------
+//  void exporterStop( Exporter* pExporter )
+//	Stop the exporter thread, wait for it and close all connections.
+//------------------------------------------------------------------------------
+void exporterStop( Exporter* pExporter )
+{
+    uint64_t one = 1;
+
+    if ( !pExporter->bStarted )
+    {
+	return;
+    }
+
+    if ( write( pExporter->stopFd, &one, sizeof( one )) == sizeof( one ))
+    {
+	pthread_join( pExporter->thread, NULL );
+    }
+    exporterRelease( pExporter );
+    pExporter->bStarted = false;
+}
@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+//  File: 	exporter.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Prometheus exporter: a small HTTP server that serves the state of the
+//  control loop at /metrics in the Prometheus text format. The control loop
+//  publishes an ExporterSnapshot through a mailbox after every sample; the
+//  server runs on its own thread with its own scheduler and only ever reads
+//  the latest snapshot, so a scrape never touches sysfs or the I2C bus and
+//  never delays the control loop.
+//
+//------------------------------------------------------------------------------
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "scheduler.h"
+#include "mailbox.h"
+#include "thermal.h"
+#include "cpustat.h"
+#include "throttle.h"
+
+#define EXPORTER_MAX_CLIENTS	8	// connections served at the same time
+#define EXPORTER_TIMEOUT_MS	2000	// to send a request
+#define EXPORTER_REQUEST_SIZE	512
+#define EXPORTER_BUCKETS	8	// histogram buckets, +Inf not included
+
+// Histogram of durations in seconds, with the bucket bounds of exporter.c
+typedef struct ExporterHistogram
+{
+    unsigned long	counts	[ EXPORTER_BUCKETS + 1 ];	// not cumulative
+    unsigned long	count;
+    double		sum;
+} ExporterHistogram;
+
+// State of the control loop that is exported
+typedef struct ExporterSnapshot
+{
+    double		temperature;	// control temperature, Celsius
+    double		predictedTemperature;	// of the range selection
+    int			nZones;
+    char		zoneNames	[ THERMAL_MAX_ZONES ][ THERMAL_NAME_SIZE ];
+    double		zoneTemperatures[ THERMAL_MAX_ZONES ];
+    bool		zoneValid	[ THERMAL_MAX_ZONES ];
+    int			nCpus;		// -1 if not sampled yet
+    double		cpuBusy		[ CPUSTAT_MAX_CPUS + 1 ];	// [0] all
+    bool		bThrottleValid;	// throttle flags could be read
+    uint32_t		throttleFlags;	// get_throttled, see throttle.h
+    unsigned long	throttleCounts	[ THROTTLE_NUM_FLAGS ];
+    long		armFreqKHz;	// 0 if unknown
+    int			fanValue;	// fan register, -1 if not written yet
+    int			band;		// temperature range, -1 if none yet
+    unsigned long	bandChanges;	// range transitions
+    unsigned long	hatTransfers;	// register writes to the hat
+    unsigned long	i2cTransfers;	// all devices on the bus
+    unsigned long	i2cErrors;
+    ExporterHistogram	sampleDuration;	// of the sample task
+    ExporterHistogram	sampleLateness;	// sample task start after its period
+} ExporterSnapshot;
+
+struct Exporter;
+
+typedef struct ExporterClient
+{
+    struct Exporter*	pExporter;
+    int			fd;		// -1 if the slot is free
+    long long		acceptedMs;
+    int			length;
+    char		request	[ EXPORTER_REQUEST_SIZE ];
+} ExporterClient;
+
+typedef struct Exporter
+{
+    int			listenFd;
+    int			stopFd;		// eventfd that stops the thread
+    Scheduler		sched;
+    Mailbox		mailbox;
+    ExporterClient	clients	[ EXPORTER_MAX_CLIENTS ];
+    pthread_t		thread;
+    bool		bStarted;
+    unsigned long	nScrapes;
+} Exporter;
+
+void		exporterObserve( ExporterHistogram* pHistogram, double seconds );
+int		exporterStart( Exporter* pExporter, int port );
+ExporterSnapshot* exporterSnapshot( Exporter* pExporter );
+void		exporterPublish( Exporter* pExporter );
+void		exporterStop( Exporter* pExporter );
+
+#endif
@@ -0,0 +1,528 @@
+//------------------------------------------------------------------------------
+//  File: 	fanpolicy.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Temperature band table, see fanpolicy.h.
+//
+//  Config file format: one band per line, in ascending order of temperature:
+//	band <lower bound C> <fan register> <red> <green> <blue> [<hysteresis C>]
+//  and optionally the settings:
+//	hysteresis <C>		for bands that do not specify their own
+//	dwell <seconds>		before stepping down
+//	setpoint <C>		temperature the PID mode regulates to
+//	pid <kp> <ki> <kd>	gains of the PID mode, in fan duty (0..1) per
+//				degree, per degree second and per degree/second
+//	predict <horizon s> <samples> <C per 100% load>
+//				select the band for the temperature expected
+//				after the horizon, see policyPredict
+//	dim <from hour> <to hour>
+//				dim the display between these local hours
+//	blank <seconds>		switch the display off when the band has not
+//				changed for this long
+//  Numbers may be decimal or 0x-prefixed hexadecimal. Empty lines and text
+//  after '#' are ignored.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fanpolicy.h"
+
+#define POLICY_LINE_SIZE 	256
+
+// Built-in table, as used before the table could be configured
+static const FanBand defaultBands[] =
+{
+    //  lower  fan   red   green blue  hysteresis
+    {   0.0,   0x00, 0x00, 0x88, 0x00, POLICY_HYSTERESIS },	// off
+    {  40.0,   0x02, 0x00, 0x44, 0x44, POLICY_HYSTERESIS },	// 20%
+    {  45.0,   0x04, 0x00, 0x00, 0x88, POLICY_HYSTERESIS },	// 40%
+    {  47.0,   0x06, 0x44, 0x00, 0x44, POLICY_HYSTERESIS },	// 60%
+    {  49.0,   0x08, 0x88, 0x00, 0x00, POLICY_HYSTERESIS },	// 80%
+    {  51.0,   0x09, 0xff, 0x00, 0x00, POLICY_HYSTERESIS },	// 90%
+    {  53.0,   0x01, 0xff, 0xff, 0xff, POLICY_HYSTERESIS }	// full speed
+};
+
+
+//------------------------------------------------------------------------------
+//  void policyDefault( FanPolicy* pPolicy )
+//	Fill pPolicy with the built-in table.
+//------------------------------------------------------------------------------
+void policyDefault( FanPolicy* pPolicy )
+{
+    memset( pPolicy, 0, sizeof( *pPolicy ));
+    pPolicy->nBands = sizeof( defaultBands ) / sizeof( defaultBands[ 0 ] );
+    memcpy( pPolicy->bands, defaultBands, sizeof( defaultBands ));
+    pPolicy->dwellMs = POLICY_DWELL_MS;
+    pPolicy->setpoint = POLICY_SETPOINT;
+    pPolicy->kp = POLICY_KP;
+    pPolicy->ki = POLICY_KI;
+    pPolicy->kd = POLICY_KD;
+    pPolicy->predictHorizonS = 0.0;
+    pPolicy->predictSamples = POLICY_PREDICT_SAMPLES;
+    pPolicy->predictLoadGain = 0.0;
+    pPolicy->dimFromHour = 0;
+    pPolicy->dimToHour = 0;
+    pPolicy->blankMs = 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool parseByte( const char* pText, long max, unsigned char* pValue )
+//	Parse an integer in the range 0..max.
+//	Returns true on success
+//------------------------------------------------------------------------------
+static bool parseByte( const char* pText, long max, unsigned char* pValue )
+{
+    char*	pEnd;
+    long	value;
+
+    if ( pText == NULL )
+    {
+	return false;
+    }
+
+    value = strtol( pText, &pEnd, 0 );
+    if ( *pEnd != '\0' || value < 0 || value > max )
+    {
+	return false;
+    }
+    *pValue = (unsigned char)value;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool parseDouble( const char* pText, double* pValue )
+//	Parse a number of at least 0.
+//	Returns true on success
+//------------------------------------------------------------------------------
+static bool parseDouble( const char* pText, double* pValue )
+{
+    char*	pEnd;
+
+    if ( pText == NULL )
+    {
+	return false;
+    }
+
+    *pValue = strtod( pText, &pEnd );
+    return pEnd != pText && *pEnd == '\0' && *pValue >= 0.0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static const char* singleArg( char* pArgs )
+//	Returns the only argument in pArgs, or NULL if there is not exactly one
+//------------------------------------------------------------------------------
+static const char* singleArg( char* pArgs )
+{
+    char*	pSave = NULL;
+    char*	pArg = strtok_r( pArgs, " \t", &pSave );
+
+    return strtok_r( NULL, " \t", &pSave ) == NULL ? pArg : NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int parseGains( FanPolicy* pPolicy, char* pArgs )
+//	Parse the arguments of a "pid" line.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int parseGains( FanPolicy* pPolicy, char* pArgs )
+{
+    char*	pSave = NULL;
+    char*	pKp = strtok_r( pArgs, " \t", &pSave );
+    char*	pKi = strtok_r( NULL, " \t", &pSave );
+    char*	pKd = strtok_r( NULL, " \t", &pSave );
+
+    if ( strtok_r( NULL, " \t", &pSave ) != NULL ||
+	 !parseDouble( pKp, &pPolicy->kp ) ||
+	 !parseDouble( pKi, &pPolicy->ki ) ||
+	 !parseDouble( pKd, &pPolicy->kd ))
+    {
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int parsePredict( FanPolicy* pPolicy, char* pArgs )
+//	Parse the arguments of a "predict" line.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int parsePredict( FanPolicy* pPolicy, char* pArgs )
+{
+    char*		pSave = NULL;
+    char*		pHorizon = strtok_r( pArgs, " \t", &pSave );
+    char*		pSamples = strtok_r( NULL, " \t", &pSave );
+    char*		pGain = strtok_r( NULL, " \t", &pSave );
+    unsigned char	samples;
+
+    if ( strtok_r( NULL, " \t", &pSave ) != NULL ||
+	 !parseDouble( pHorizon, &pPolicy->predictHorizonS ) ||
+	 !parseByte( pSamples, POLICY_PREDICT_MAX_SAMPLES, &samples ) ||
+	 samples < 2 ||
+	 !parseDouble( pGain, &pPolicy->predictLoadGain ))
+    {
+	return -1;
+    }
+    pPolicy->predictSamples = samples;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int parseDim( FanPolicy* pPolicy, char* pArgs )
+//	Parse the arguments of a "dim" line.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int parseDim( FanPolicy* pPolicy, char* pArgs )
+{
+    char*		pSave = NULL;
+    char*		pFrom = strtok_r( pArgs, " \t", &pSave );
+    char*		pTo = strtok_r( NULL, " \t", &pSave );
+    unsigned char	from;
+    unsigned char	to;
+
+    if ( strtok_r( NULL, " \t", &pSave ) != NULL ||
+	 !parseByte( pFrom, 23, &from ) ||
+	 !parseByte( pTo, 23, &to ))
+    {
+	return -1;
+    }
+    pPolicy->dimFromHour = from;
+    pPolicy->dimToHour = to;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int parseBand( FanPolicy* pPolicy, char* pArgs )
+//	Parse the arguments of a "band" line and append the band. A band
+//	without hysteresis gets a negative one, to be filled in by the caller.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int parseBand( FanPolicy* pPolicy, char* pArgs )
+{
+    const char*	pField[ 6 ];
+    char*	pSave = NULL;
+    char*	pEnd;
+    FanBand	band;
+    int		i;
+
+    for ( i = 0; i < 6; i++ )
+    {
+	pField[ i ] = strtok_r( i == 0 ? pArgs : NULL, " \t", &pSave );
+    }
+    if ( pField[ 0 ] == NULL || strtok_r( NULL, " \t", &pSave ) != NULL )
+    {
+	return -1;
+    }
+
+    band.lower = strtod( pField[ 0 ], &pEnd );
+    band.hysteresis = -1.0;
+    if ( pField[ 5 ] != NULL && !parseDouble( pField[ 5 ], &band.hysteresis ))
+    {
+	return -1;
+    }
+    if ( *pEnd != '\0' ||
+	 !parseByte( pField[ 1 ], 0x09, &band.fanValue ) ||
+	 !parseByte( pField[ 2 ], 0xff, &band.red ) ||
+	 !parseByte( pField[ 3 ], 0xff, &band.green ) ||
+	 !parseByte( pField[ 4 ], 0xff, &band.blue ))
+    {
+	return -1;
+    }
+
+    if ( pPolicy->nBands >= POLICY_MAX_BANDS ||
+	 (pPolicy->nBands > 0 &&
+	  band.lower <= pPolicy->bands[ pPolicy->nBands - 1 ].lower ))
+    {
+	return -1;
+    }
+
+    pPolicy->bands[ pPolicy->nBands++ ] = band;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int policyLoad( FanPolicy* pPolicy, const char* pPath )
+//	Read the band table from config file pPath. pPolicy is only changed
+//	if the whole file is valid, so a bad edit of the file leaves the
+//	current table in place.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int policyLoad( FanPolicy* pPolicy, const char* pPath )
+{
+    FanPolicy	policy;
+    char 	line	[ POLICY_LINE_SIZE ];
+    double	hysteresis = POLICY_HYSTERESIS;
+    double	dwell = 0.0;
+    double	blank = 0.0;
+    int		lineNumber = 0;
+    int		returnValue = 0;
+    int		i;
+    FILE*	pFile = fopen( pPath, "re" );
+
+    if ( pFile == NULL )
+    {
+	fprintf( stderr, "Could not open config file %s\n", pPath );
+	return -1;
+    }
+
+    policyDefault( &policy );
+    policy.nBands = 0;
+    while ( returnValue == 0 && fgets( line, sizeof( line ), pFile ) != NULL )
+    {
+	char*	pKeyword;
+	char*	pArgs;
+
+	lineNumber++;
+	line[ strcspn( line, "#\r\n" ) ] = '\0';
+
+	pKeyword = line + strspn( line, " \t" );
+	if ( *pKeyword == '\0' )
+	{
+	    continue;
+	}
+	pArgs = pKeyword + strcspn( pKeyword, " \t" );
+	if ( *pArgs != '\0' )
+	{
+	    *pArgs++ = '\0';
+	}
+
+	if ( strcmp( pKeyword, "band" ) == 0 )
+	{
+	    returnValue = parseBand( &policy, pArgs );
+	}
+	else if ( strcmp( pKeyword, "hysteresis" ) == 0 )
+	{
+	    returnValue = parseDouble( singleArg( pArgs ), &hysteresis ) ? 0 : -1;
+	}
+	else if ( strcmp( pKeyword, "dwell" ) == 0 )
+	{
+	    returnValue = parseDouble( singleArg( pArgs ), &dwell ) &&
+			  dwell <= 3600.0 ? 0 : -1;
+	    policy.dwellMs = (int)(dwell * 1000.0);
+	}
+	else if ( strcmp( pKeyword, "setpoint" ) == 0 )
+	{
+	    returnValue = parseDouble( singleArg( pArgs ), &policy.setpoint )
+			  ? 0 : -1;
+	}
+	else if ( strcmp( pKeyword, "pid" ) == 0 )
+	{
+	    returnValue = parseGains( &policy, pArgs );
+	}
+	else if ( strcmp( pKeyword, "predict" ) == 0 )
+	{
+	    returnValue = parsePredict( &policy, pArgs );
+	}
+	else if ( strcmp( pKeyword, "dim" ) == 0 )
+	{
+	    returnValue = parseDim( &policy, pArgs );
+	}
+	else if ( strcmp( pKeyword, "blank" ) == 0 )
+	{
+	    returnValue = parseDouble( singleArg( pArgs ), &blank ) &&
+			  blank <= 86400.0 ? 0 : -1;
+	    policy.blankMs = (int)(blank * 1000.0);
+	}
+	else
+	{
+	    returnValue = -1;
+	}
+
+	if ( returnValue != 0 )
+	{
+	    fprintf( stderr, "%s:%d: invalid line\n", pPath, lineNumber );
+	}
+    }
+    fclose( pFile );
+
+    for ( i = 0; i < policy.nBands; i++ )
+    {
+	if ( policy.bands[ i ].hysteresis < 0.0 )
+	{
+	    policy.bands[ i ].hysteresis = hysteresis;
+	}
+    }
+
+    if ( returnValue == 0 && policy.nBands == 0 )
+    {
+	fprintf( stderr, "%s: no bands defined\n", pPath );
+	returnValue = -1;
+    }
+
+    if ( returnValue == 0 )
+    {
+	*pPolicy = policy;
+    }
+    return returnValue;
+}
+
+
+//------------------------------------------------------------------------------
+//  int policyBand( const FanPolicy* pPolicy, double temperature )
+//	Binary search for the band that temperature (degrees Celsius) lies in.
+//	Returns the index of the band
+//------------------------------------------------------------------------------
+int policyBand( const FanPolicy* pPolicy, double temperature )
+{
+    int low = 0;
+    int high = pPolicy->nBands - 1;
+
+    // Invariant: the band is in [low, high]
+    while ( low < high )
+    {
+	int middle = (low + high + 1) / 2;
+
+	if ( temperature >= pPolicy->bands[ middle ].lower )
+	{
+	    low = middle;
+	}
+	else
+	{
+	    high = middle - 1;
+	}
+    }
+    return low;
+}
+
+
+//------------------------------------------------------------------------------
+//  void policyResetState( FanState* pState )
+//	Forget the applied band, so the next update applies a band right away.
+//------------------------------------------------------------------------------
+void policyResetState( FanState* pState )
+{
+    pState->band = -1;
+    pState->sinceMs = 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  bool policyUpdate( const FanPolicy* pPolicy, FanState* pState,
+//		       double temperature, long long nowMs )
+//	Select the band for temperature (degrees Celsius) at monotonic time
+//	nowMs, starting from the band in pState. A hotter band is selected
+//	right away. A cooler band only after the dwell time, and only as far
+//	down as the temperature is at least the hysteresis below the lower
+//	bound of each band that is left.
+//	Returns true if pState->band changed and has to be applied
+//------------------------------------------------------------------------------
+bool policyUpdate( const FanPolicy* pPolicy, FanState* pState,
+		   double temperature, long long nowMs )
+{
+    int band = policyBand( pPolicy, temperature );
+    int current = pState->band;
+
+    if ( current < 0 || current >= pPolicy->nBands || band > current )
+    {
+	// First decision, or stepping up
+	pState->band = band;
+	pState->sinceMs = nowMs;
+	return true;
+    }
+
+    if ( band == current || nowMs - pState->sinceMs < pPolicy->dwellMs )
+    {
+	return false;
+    }
+
+    // Stepping down: leave each band only below its lower bound - hysteresis
+    band = current;
+    while ( band > 0 && temperature < pPolicy->bands[ band ].lower -
+				      pPolicy->bands[ band ].hysteresis )
+    {
+	band--;
+    }
+
+    if ( band == current )
+    {
+	return false;
+    }
+    pState->band = band;
+    pState->sinceMs = nowMs;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//  double policyPredict( const FanPolicy* pPolicy,
+//			  const HistoryRecord* pRecords, int nRecords,
+//			  double periodS, double temperature, double cpuBusy )
+//	Estimate the temperature predictHorizonS seconds ahead, from the
+//	current temperature (degrees Celsius), the slope of a least squares
+//	fit through the recent history records (oldest first), and the rise of
+//	the CPU utilization (percent) since the oldest record. Only rising
+//	trends count: the prediction never lies below the current temperature,
+//	so it can only make the fan step up earlier or stay up longer.
+//	The records are appended every periodS seconds. Their wall clock
+//	times can step when NTP sets the clock, so a step between two records
+//	that is not forward, or more than POLICY_PREDICT_MAX_STEP periods, is
+//	taken as one period.
+//	Returns the temperature to select the band for
+//------------------------------------------------------------------------------
+double policyPredict( const FanPolicy* pPolicy, const HistoryRecord* pRecords,
+		      int nRecords, double periodS, double temperature,
+		      double cpuBusy )
+{
+    double	x = 0.0;
+    double	sumX = 0.0;
+    double	sumY = 0.0;
+    double	sumXX = 0.0;
+    double	sumXY = 0.0;
+    double	denominator;
+    double	slope = 0.0;
+    double	loadRise;
+    double	predicted = temperature;
+    int		i;
+
+    if ( pPolicy->predictHorizonS <= 0.0 || nRecords < 2 )
+    {
+	return temperature;
+    }
+
+    for ( i = 0; i < nRecords; i++ )
+    {
+	double y = pRecords[ i ].temperature / 100.0;
+
+	if ( i > 0 )
+	{
+	    // Signed, so a backward step does not wrap around
+	    int32_t step = (int32_t)(pRecords[ i ].time - pRecords[ i - 1 ].time);
+
+	    x += (step > 0 && step <= POLICY_PREDICT_MAX_STEP * periodS)
+		 ? step : periodS;
+	}
+
+	sumX += x;
+	sumY += y;
+	sumXX += x * x;
+	sumXY += x * y;
+    }
+
+    denominator = nRecords * sumXX - sumX * sumX;
+    if ( denominator > 0.0 )
+    {
+	slope = (nRecords * sumXY - sumX * sumY) / denominator;
+    }
+    if ( slope > 0.0 )
+    {
+	predicted += slope * pPolicy->predictHorizonS;
+    }
+
+    loadRise = cpuBusy - pRecords[ 0 ].cpuLoad;
+    if ( loadRise > 0.0 )
+    {
+	predicted += pPolicy->predictLoadGain * loadRise / 100.0;
+    }
+    return predicted;
+}
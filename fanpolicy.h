@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+//  File: 	fanpolicy.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Table of temperature bands with the fan speed and LED color of each band.
+//  The table is sorted on the lower bound of the bands; a temperature belongs
+//  to the last band whose lower bound it reaches, and temperatures below the
+//  first bound belong to the first band.
+//
+//  Stepping up to a hotter band happens as soon as its lower bound is reached.
+//  Stepping down requires the temperature to drop the hysteresis of the band
+//  below its lower bound, and the band to have been applied for at least the
+//  dwell time. This keeps the fan from hunting around a band boundary.
+//
+//  Optionally, the band is selected for a predicted temperature instead of
+//  the current one, see policyPredict, so the fan ramps up before a load
+//  burst has heated the die.
+//
+//  The built-in table can be replaced by a config file, see policyLoad.
+//
+//------------------------------------------------------------------------------
+#ifndef FANPOLICY_H
+#define FANPOLICY_H
+
+#include <stdbool.h>
+
+#include "history.h"
+
+#define POLICY_MAX_BANDS 	16
+
+#define POLICY_HYSTERESIS	0.5	// default degrees Celsius
+#define POLICY_DWELL_MS		10000	// default dwell time before stepping down
+
+// Defaults of the PID control mode
+#define POLICY_SETPOINT		48.0	// degrees Celsius
+#define POLICY_KP		0.1	// duty per degree
+#define POLICY_KI		0.005	// duty per degree second
+#define POLICY_KD		0.0	// duty per degree per second
+
+// Defaults of the prediction, which is off unless a horizon is configured
+#define POLICY_PREDICT_SAMPLES	10	// history records for the slope
+#define POLICY_PREDICT_MAX_SAMPLES 60
+#define POLICY_PREDICT_MAX_STEP	4	// record periods between two records;
+					// more is taken for a clock step
+
+typedef struct FanBand
+{
+    double		lower;		// degrees Celsius
+    unsigned char	fanValue;	// fan register 0x08: 0 off, 1 full,
+					// 2..9 is 20%..90%
+    unsigned char	red;
+    unsigned char	green;
+    unsigned char	blue;
+    double		hysteresis;	// degrees Celsius, to leave the band
+} FanBand;
+
+typedef struct FanPolicy
+{
+    int		nBands;
+    FanBand	bands	[ POLICY_MAX_BANDS ];
+    int		dwellMs;	// minimum time in a band before stepping down
+
+    // PID control mode; the bands then only select the LED color
+    double	setpoint;	// degrees Celsius
+    double	kp;
+    double	ki;
+    double	kd;
+
+    // Feed-forward of the band selection
+    double	predictHorizonS;	// look ahead, 0 for no prediction
+    int		predictSamples;		// history records of the slope
+    double	predictLoadGain;	// degrees per 100% CPU increase
+
+    // Power saving of the OLED display
+    int		dimFromHour;	// dimmed from this local hour ...
+    int		dimToHour;	// ... until this one; never if equal
+    int		blankMs;	// off this long after a band change, 0 never
+} FanPolicy;
+
+// Band that is currently applied
+typedef struct FanState
+{
+    int		band;		// -1 if none yet
+    long long	sinceMs;	// monotonic time the band was entered
+} FanState;
+
+void	policyDefault( FanPolicy* pPolicy );
+int	policyLoad( FanPolicy* pPolicy, const char* pPath );
+int	policyBand( const FanPolicy* pPolicy, double temperature );
+void	policyResetState( FanState* pState );
+bool	policyUpdate( const FanPolicy* pPolicy, FanState* pState,
+		      double temperature, long long nowMs );
+double	policyPredict( const FanPolicy* pPolicy, const HistoryRecord* pRecords,
+		       int nRecords, double periodS, double temperature,
+		       double cpuBusy );
+
+#endif
@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+//  File: 	history.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Sample history ring, see history.h.
+//
+//  Record n (counting from the first append) lives in slot n % capacity. The
+//  writer fills the slot and then publishes it by incrementing head with
+//  release ordering. A reader loads head, copies the records it wants, and
+//  loads head again: a record n was possibly overwritten during the copy if
+//  n < head - capacity + 1 for the second head, since the writer may be
+//  filling slot head % capacity at that moment.
+//
+//  Records are copied in and out of the ring with relaxed atomic byte
+//  accesses, so a copy that overlaps a write returns stale bytes, which the
+//  reader then drops, rather than being a data race. A release fence keeps
+//  the bytes of a new record from becoming visible before the head that
+//  precedes it: a reader that got any of them sees that head on its second
+//  load, after its acquire fence, and leaves the old record out.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+
+//------------------------------------------------------------------------------
+//  int historyInit( History* pHistory, uint32_t capacity )
+//	Allocate a history of capacity records (at least 2).
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int historyInit( History* pHistory, uint32_t capacity )
+{
+    atomic_init( &pHistory->head, 0 );
+    pHistory->capacity = (capacity < 2) ? 2 : capacity;
+    pHistory->pRecords = calloc( pHistory->capacity, sizeof( HistoryRecord ));
+    if ( pHistory->pRecords == NULL )
+    {
+	fprintf( stderr, "Could not allocate history\n" );
+	pHistory->capacity = 0;
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void storeRecord( HistoryRecord* pSlot, const HistoryRecord* pRecord )
+//	Copy pRecord into slot pSlot of the ring, byte by byte.
+//------------------------------------------------------------------------------
+static void storeRecord( HistoryRecord* pSlot, const HistoryRecord* pRecord )
+{
+    unsigned char*		pTo = (unsigned char*)pSlot;
+    const unsigned char*	pFrom = (const unsigned char*)pRecord;
+    size_t			i;
+
+    for ( i = 0; i < sizeof( HistoryRecord ); i++ )
+    {
+	__atomic_store_n( &pTo[ i ], pFrom[ i ], __ATOMIC_RELAXED );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void loadRecord( HistoryRecord* pRecord, const HistoryRecord* pSlot )
+//	Copy slot pSlot of the ring into pRecord, byte by byte.
+//------------------------------------------------------------------------------
+static void loadRecord( HistoryRecord* pRecord, const HistoryRecord* pSlot )
+{
+    unsigned char*		pTo = (unsigned char*)pRecord;
+    const unsigned char*	pFrom = (const unsigned char*)pSlot;
+    size_t			i;
+
+    for ( i = 0; i < sizeof( HistoryRecord ); i++ )
+    {
+	pTo[ i ] = __atomic_load_n( &pFrom[ i ], __ATOMIC_RELAXED );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void historyAppend( History* pHistory, const HistoryRecord* pRecord )
+//	Append a record, overwriting the oldest one when the ring is full.
+//	Only one thread may append.
+//------------------------------------------------------------------------------
+void historyAppend( History* pHistory, const HistoryRecord* pRecord )
+{
+    uint64_t head = atomic_load_explicit( &pHistory->head,
+					  memory_order_relaxed );
+
+    if ( pHistory->capacity == 0 )
+    {
+	return;
+    }
+
+    // Not before the previous head, see above
+    atomic_thread_fence( memory_order_release );
+    storeRecord( &pHistory->pRecords[ head % pHistory->capacity ], pRecord );
+    atomic_store_explicit( &pHistory->head, head + 1, memory_order_release );
+}
+
+
+//------------------------------------------------------------------------------
+//  uint64_t historyCount( const History* pHistory )
+//	Returns the number of records appended so far, including the ones that
+//	were overwritten; the newest record has number count - 1
+//------------------------------------------------------------------------------
+uint64_t historyCount( const History* pHistory )
+{
+    return atomic_load_explicit( &pHistory->head, memory_order_acquire );
+}
+
+
+//------------------------------------------------------------------------------
+//  int historyRead( const History* pHistory, uint64_t first,
+//		     HistoryRecord* pRecords, int count, uint64_t* pFirstRead )
+//	Copy up to count records, starting at record number first, oldest
+//	first. If record first is no longer in the ring, the copy starts at the
+//	oldest record that is; *pFirstRead (if not NULL) is set to the number
+//	of the first record copied.
+//	Returns the number of records copied
+//------------------------------------------------------------------------------
+int historyRead( const History* pHistory, uint64_t first,
+		 HistoryRecord* pRecords, int count, uint64_t* pFirstRead )
+{
+    uint64_t	head = historyCount( pHistory );
+    uint64_t	oldest;
+    uint64_t	n;
+    int		nCopied = 0;
+
+    if ( pHistory->capacity == 0 || count <= 0 )
+    {
+	return 0;
+    }
+
+    // The slot of record head may be being written already
+    oldest = (head >= pHistory->capacity) ? head - pHistory->capacity + 1 : 0;
+    if ( first < oldest )
+    {
+	first = oldest;
+    }
+
+    for ( n = first; n < head && nCopied < count; n++ )
+    {
+	loadRecord( &pRecords[ nCopied++ ],
+		    &pHistory->pRecords[ n % pHistory->capacity ] );
+    }
+
+    // Drop what the writer overwrote in the meantime
+    atomic_thread_fence( memory_order_acquire );
+    head = historyCount( pHistory );
+    oldest = (head >= pHistory->capacity) ? head - pHistory->capacity + 1 : 0;
+    if ( first < oldest )
+    {
+	uint64_t lost = oldest - first;
+
+	if ( lost >= (uint64_t)nCopied )
+	{
+	    nCopied = 0;
+	}
+	else
+	{
+	    memmove( pRecords, pRecords + lost,
+		     (nCopied - lost) * sizeof( HistoryRecord ));
+	    nCopied -= lost;
+	}
+	first = oldest;
+    }
+
+    if ( pFirstRead != NULL )
+    {
+	*pFirstRead = first;
+    }
+    return nCopied;
+}
+
+
+//------------------------------------------------------------------------------
+//  int historyLatest( const History* pHistory, HistoryRecord* pRecords,
+//		       int count )
+//	Copy the newest count records (or fewer, if there are not that many),
+//	oldest first.
+//	Returns the number of records copied
+//------------------------------------------------------------------------------
+int historyLatest( const History* pHistory, HistoryRecord* pRecords, int count )
+{
+    uint64_t head = historyCount( pHistory );
+    uint64_t first = (head > (uint64_t)count) ? head - count : 0;
+
+    return historyRead( pHistory, first, pRecords, count, NULL );
+}
+
+
+//------------------------------------------------------------------------------
+//  int16_t historyTemperature( double temperature )
+//	Returns temperature (degrees Celsius) in the unit of the records
+//------------------------------------------------------------------------------
+int16_t historyTemperature( double temperature )
+{
+    double value = temperature * 100.0;
+
+    if ( value >= INT16_MAX )
+    {
+	return INT16_MAX;
+    }
+    if ( value <= INT16_MIN + 1 )
+    {
+	return INT16_MIN + 1;
+    }
+    return (int16_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+
+//------------------------------------------------------------------------------
+//  void historyClose( History* pHistory )
+//	Release the records. No thread may use the history anymore.
+//------------------------------------------------------------------------------
+void historyClose( History* pHistory )
+{
+    free( pHistory->pRecords );
+    pHistory->pRecords = NULL;
+    pHistory->capacity = 0;
+}
@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------
+//  File: 	history.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  In-memory history of temperature, fan and CPU samples. The history is a
+//  ring of packed records that is allocated once; the control loop appends
+//  to it without allocating or locking, and any number of other threads can
+//  copy records out of it at the same time. A reader detects records that
+//  were overwritten while it copied them and leaves them out.
+//
+//  At the default of one record per second, 24 hours of history take
+//  86400 records of 14 bytes, about 1.2 MB.
+//
+//------------------------------------------------------------------------------
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HISTORY_CAPACITY 	86400	// records, 24 h at 1 Hz
+#define HISTORY_ZONES		3	// zone temperatures per record
+#define HISTORY_NO_VALUE	INT16_MIN	// zone/temperature not available
+
+// One sample. Temperatures are in 1/100 degrees Celsius.
+typedef struct __attribute__(( packed )) HistoryRecord
+{
+    uint32_t	time;			// seconds since the epoch
+    int16_t	temperature;		// control temperature
+    int16_t	zones	[ HISTORY_ZONES ];	// first zones of thermal.h
+    uint8_t	fanValue;		// fan register, 0xff if unknown
+    uint8_t	cpuLoad;		// utilization of all cores, percent
+} HistoryRecord;
+
+typedef struct History
+{
+    HistoryRecord*	pRecords;
+    uint32_t		capacity;
+    atomic_uint_fast64_t head;		// records appended so far
+} History;
+
+int		historyInit( History* pHistory, uint32_t capacity );
+void		historyAppend( History* pHistory, const HistoryRecord* pRecord );
+uint64_t	historyCount( const History* pHistory );
+int		historyRead( const History* pHistory, uint64_t first,
+			     HistoryRecord* pRecords, int count,
+			     uint64_t* pFirstRead );
+int		historyLatest( const History* pHistory, HistoryRecord* pRecords,
+			       int count );
+int16_t		historyTemperature( double temperature );
+void		historyClose( History* pHistory );
+
+#endif
@@ -0,0 +1,254 @@
+//------------------------------------------------------------------------------
+//  File: 	i2cbackend.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  I2C bus backends, see i2cbackend.h.
+//
+//  wiringPi only offers a handle bound to one slave address, so that backend
+//  opens one per address on first use. A two byte transfer (register and
+//  value, as the hat writes them) goes through wiringPiI2CWriteReg8; longer
+//  ones are written to the handle directly.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#ifdef USE_WIRINGPI
+#include <wiringPiI2C.h>
+#endif
+
+#include "i2cbus.h"
+
+
+//------------------------------------------------------------------------------
+//  i2c backend: I2C_RDWR on the adapter device
+//------------------------------------------------------------------------------
+static int ioctlOpen( I2cBus* pBus, const char* pPath )
+{
+    if ( pPath == NULL )
+    {
+	pPath = I2C_BUS_PATH;
+    }
+    pBus->fd = open( pPath, O_RDWR | O_CLOEXEC );
+    if ( pBus->fd < 0 )
+    {
+	fprintf( stderr, "Could not open I2C adapter %s\n", pPath );
+	return -1;
+    }
+    return 0;
+}
+
+static int ioctlWrite( I2cBus* pBus, unsigned int i2caddr, const void* pData,
+		       int len )
+{
+    struct i2c_msg		message;
+    struct i2c_rdwr_ioctl_data	transfer;
+
+    message.addr = i2caddr;
+    message.flags = 0;
+    message.len = len;
+    message.buf = (void*)pData;
+    transfer.msgs = &message;
+    transfer.nmsgs = 1;
+
+    return ioctl( pBus->fd, I2C_RDWR, &transfer ) == 1 ? 0 : -1;
+}
+
+static void ioctlClose( I2cBus* pBus )
+{
+    if ( pBus->fd >= 0 )
+    {
+	close( pBus->fd );
+	pBus->fd = -1;
+    }
+}
+
+const I2cBackend gI2cBackendIoctl =
+{
+    "i2c", ioctlOpen, ioctlWrite, ioctlClose
+};
+
+
+#ifdef USE_WIRINGPI
+//------------------------------------------------------------------------------
+//  wiringPi backend
+//------------------------------------------------------------------------------
+static int wiringPiOpen( I2cBus* pBus, const char* pPath )
+{
+    pBus->nDevices = 0;
+    pBus->pDevicePath = pPath;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//  static int wiringPiDevice( I2cBus* pBus, unsigned int i2caddr )
+//	Returns the handle of the device at i2caddr, opened on first use, or
+//	-1 if it could not be opened
+//------------------------------------------------------------------------------
+static int wiringPiDevice( I2cBus* pBus, unsigned int i2caddr )
+{
+    int fd;
+    int i;
+
+    for ( i = 0; i < pBus->nDevices; i++ )
+    {
+	if ( pBus->deviceAddrs[ i ] == i2caddr )
+	{
+	    return pBus->deviceFds[ i ];
+	}
+    }
+    if ( pBus->nDevices == I2C_BACKEND_MAX_DEVICES )
+    {
+	return -1;
+    }
+
+    fd = (pBus->pDevicePath != NULL) ?
+	 wiringPiI2CSetupInterface( pBus->pDevicePath, i2caddr ) :
+	 wiringPiI2CSetup( i2caddr );
+    if ( fd < 0 )
+    {
+	fprintf( stderr, "Could not open I2C device 0x%02x\n", i2caddr );
+	return -1;
+    }
+    pBus->deviceAddrs[ pBus->nDevices ] = i2caddr;
+    pBus->deviceFds[ pBus->nDevices ] = fd;
+    pBus->nDevices++;
+    return fd;
+}
+
+static int wiringPiWrite( I2cBus* pBus, unsigned int i2caddr,
+			  const void* pData, int len )
+{
+    const unsigned char*	pBytes = pData;
+    int				fd = wiringPiDevice( pBus, i2caddr );
+
+    if ( fd < 0 )
+    {
+	return -1;
+    }
+    if ( len == 2 )
+    {
+	return wiringPiI2CWriteReg8( fd, pBytes[ 0 ], pBytes[ 1 ] ) < 0 ? -1 : 0;
+    }
+    return write( fd, pData, len ) == len ? 0 : -1;
+}
+
+static void wiringPiClose( I2cBus* pBus )
+{
+    int i;
+
+    for ( i = 0; i < pBus->nDevices; i++ )
+    {
+	close( pBus->deviceFds[ i ] );
+    }
+    pBus->nDevices = 0;
+}
+
+const I2cBackend gI2cBackendWiringPi =
+{
+    "wiringPi", wiringPiOpen, wiringPiWrite, wiringPiClose
+};
+#endif
+
+
+//------------------------------------------------------------------------------
+//  mock backend: no hardware, optional record file
+//------------------------------------------------------------------------------
+static int mockOpen( I2cBus* pBus, const char* pPath )
+{
+    if ( pPath == NULL )
+    {
+	pBus->pRecord = NULL;
+	return 0;
+    }
+    pBus->pRecord = fopen( pPath, "we" );
+    if ( pBus->pRecord == NULL )
+    {
+	fprintf( stderr, "Could not create I2C record %s\n", pPath );
+	return -1;
+    }
+    return 0;
+}
+
+static int mockWrite( I2cBus* pBus, unsigned int i2caddr, const void* pData,
+		      int len )
+{
+    const unsigned char*	pBytes = pData;
+    long long			timeUs;
+    int				i;
+
+    if ( pBus->pRecord == NULL )
+    {
+	return 0;
+    }
+
+    if ( pBus->pClockUs != NULL )
+    {
+	timeUs = pBus->pClockUs();
+    }
+    else
+    {
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	timeUs = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    }
+
+    fprintf( pBus->pRecord, "%lld %02x %d", timeUs, i2caddr, len );
+    for ( i = 0; i < len; i++ )
+    {
+	fprintf( pBus->pRecord, " %02x", pBytes[ i ] );
+    }
+    fputc( '\n', pBus->pRecord );
+    return 0;
+}
+
+static void mockClose( I2cBus* pBus )
+{
+    if ( pBus->pRecord != NULL )
+    {
+	fclose( pBus->pRecord );
+	pBus->pRecord = NULL;
+    }
+}
+
+const I2cBackend gI2cBackendMock =
+{
+    "mock", mockOpen, mockWrite, mockClose
+};
+
+
+//------------------------------------------------------------------------------
+//  const I2cBackend* i2cBackendFind( const char* pName )
+//	Returns the backend called pName, or NULL if there is none
+//------------------------------------------------------------------------------
+const I2cBackend* i2cBackendFind( const char* pName )
+{
+    static const I2cBackend* pBackends[] =
+    {
+	&gI2cBackendIoctl,
+#ifdef USE_WIRINGPI
+	&gI2cBackendWiringPi,
+#endif
+	&gI2cBackendMock
+    };
+    int i;
+
+    for ( i = 0; i < (int)(sizeof( pBackends ) / sizeof( pBackends[ 0 ] )); i++ )
+    {
+	if ( !strcmp( pBackends[ i ]->pName, pName ))
+	{
+	    return pBackends[ i ];
+	}
+    }
+    return NULL;
+}
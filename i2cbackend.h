@@ -0,0 +1,50 @@
+//------------------------------------------------------------------------------
+//  File: 	i2cbackend.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Backends of the shared I2C bus (i2cbus.h). A backend makes the transfers
+//  that the bus arbiter has serialized; the arbiter only ever calls one of
+//  its functions at a time. Available are:
+//	i2c		/dev/i2c-N, one I2C_RDWR ioctl per transfer (default)
+//	wiringPi	a wiringPiI2CSetup handle per device address; only
+//			built with -DUSE_WIRINGPI (and -lwiringPi)
+//	mock		no hardware: every transfer succeeds and is optionally
+//			recorded in a text file, one line per transfer:
+//			    <time us> <address> <length> <bytes...>
+//			all in hex but the time and the length.
+//
+//------------------------------------------------------------------------------
+#ifndef I2CBACKEND_H
+#define I2CBACKEND_H
+
+#define I2C_BACKEND_MAX_DEVICES	4	// addresses of the wiringPi backend
+
+struct I2cBus;
+
+typedef struct I2cBackend
+{
+    const char*	pName;
+
+    // Open the adapter or record file pPath; returns 0 on success, -1
+    // otherwise. A NULL path selects the default of the backend.
+    int		(*pOpen)( struct I2cBus* pBus, const char* pPath );
+
+    // Write len bytes to the device at i2caddr in one transfer; returns 0
+    // on success, -1 otherwise
+    int		(*pWrite)( struct I2cBus* pBus, unsigned int i2caddr,
+			   const void* pData, int len );
+
+    void	(*pClose)( struct I2cBus* pBus );
+} I2cBackend;
+
+extern const I2cBackend	gI2cBackendIoctl;
+#ifdef USE_WIRINGPI
+extern const I2cBackend	gI2cBackendWiringPi;
+#endif
+extern const I2cBackend	gI2cBackendMock;
+
+const I2cBackend* i2cBackendFind( const char* pName );
+
+#endif
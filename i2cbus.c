@@ -0,0 +1,164 @@
+//------------------------------------------------------------------------------
+//  File: 	i2cbus.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Shared I2C bus, see i2cbus.h.
+//
+//------------------------------------------------------------------------------
+#include <string.h>
+
+#include "i2cbus.h"
+
+
+//------------------------------------------------------------------------------
+//  int i2cBusOpen( I2cBus* pBus, const I2cBackend* pBackend,
+//		    const char* pPath )
+//	Open the bus with pBackend, on the adapter or record file pPath, or the
+//	default of the backend if pPath is NULL.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int i2cBusOpen( I2cBus* pBus, const I2cBackend* pBackend, const char* pPath )
+{
+    memset( pBus, 0, sizeof( *pBus ));
+    pthread_mutex_init( &pBus->lock, NULL );
+    pthread_cond_init( &pBus->released, NULL );
+    pBus->fd = -1;
+
+    if ( pBackend->pOpen( pBus, pPath ) != 0 )
+    {
+	return -1;
+    }
+    pBus->pBackend = pBackend;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  bool i2cBusIsOpen( const I2cBus* pBus )
+//	Returns whether transfers can be made on pBus
+//------------------------------------------------------------------------------
+bool i2cBusIsOpen( const I2cBus* pBus )
+{
+    return pBus->pBackend != NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  void i2cBusSetClock( I2cBus* pBus, long long (*pClockUs)( void ))
+//	Take the times in the record of the mock backend from pClockUs, e.g. a
+//	simulated clock, instead of the monotonic clock.
+//------------------------------------------------------------------------------
+void i2cBusSetClock( I2cBus* pBus, long long (*pClockUs)( void ))
+{
+    pBus->pClockUs = pClockUs;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void acquire( I2cBus* pBus, I2cPriority priority )
+//	Wait until the bus is free and no transfer of higher priority waits,
+//	then claim it.
+//------------------------------------------------------------------------------
+static void acquire( I2cBus* pBus, I2cPriority priority )
+{
+    pthread_mutex_lock( &pBus->lock );
+    if ( priority == I2cPrioHigh )
+    {
+	pBus->nHighWaiting++;
+	while ( pBus->bBusy )
+	{
+	    pthread_cond_wait( &pBus->released, &pBus->lock );
+	}
+	pBus->nHighWaiting--;
+    }
+    else
+    {
+	while ( pBus->bBusy || pBus->nHighWaiting > 0 )
+	{
+	    pthread_cond_wait( &pBus->released, &pBus->lock );
+	}
+    }
+    pBus->bBusy = true;
+    pthread_mutex_unlock( &pBus->lock );
+}
+
+
+//------------------------------------------------------------------------------
+//  static void release( I2cBus* pBus, bool bOk, int len )
+//	Count the transfer of len bytes, which failed unless bOk, free the bus
+//	and wake the waiting transfers.
+//------------------------------------------------------------------------------
+static void release( I2cBus* pBus, bool bOk, int len )
+{
+    pthread_mutex_lock( &pBus->lock );
+    pBus->nTransfers++;
+    if ( bOk )
+    {
+	pBus->nBytes += len;
+    }
+    else
+    {
+	pBus->nErrors++;
+    }
+    pBus->bBusy = false;
+    pthread_cond_broadcast( &pBus->released );
+    pthread_mutex_unlock( &pBus->lock );
+}
+
+
+//------------------------------------------------------------------------------
+//  int i2cBusWrite( I2cBus* pBus, I2cPriority priority, unsigned int i2caddr,
+//		     const void* pData, int len )
+//	Write len bytes (at most I2C_BUS_MAXWRITE) to the device at i2caddr in
+//	one transfer, waiting for the bus as needed.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int i2cBusWrite( I2cBus* pBus, I2cPriority priority, unsigned int i2caddr,
+		 const void* pData, int len )
+{
+    int result;
+
+    if ( !i2cBusIsOpen( pBus ) || len < 1 || len > I2C_BUS_MAXWRITE )
+    {
+	return -1;
+    }
+
+    acquire( pBus, priority );
+    result = pBus->pBackend->pWrite( pBus, i2caddr, pData, len );
+    release( pBus, result == 0, len );
+
+    return result;
+}
+
+
+//------------------------------------------------------------------------------
+//  void i2cBusCounters( I2cBus* pBus, unsigned long* pnTransfers,
+//			 unsigned long* pnErrors )
+//	Copy the transfer and error counters; can be called from any thread.
+//------------------------------------------------------------------------------
+void i2cBusCounters( I2cBus* pBus, unsigned long* pnTransfers,
+		     unsigned long* pnErrors )
+{
+    pthread_mutex_lock( &pBus->lock );
+    *pnTransfers = pBus->nTransfers;
+    *pnErrors = pBus->nErrors;
+    pthread_mutex_unlock( &pBus->lock );
+}
+
+
+//------------------------------------------------------------------------------
+//  void i2cBusClose( I2cBus* pBus )
+//	Close the backend. No transfer may be in progress or started later.
+//------------------------------------------------------------------------------
+void i2cBusClose( I2cBus* pBus )
+{
+    if ( pBus->pBackend != NULL )
+    {
+	pBus->pBackend->pClose( pBus );
+	pBus->pBackend = NULL;
+    }
+    pthread_cond_destroy( &pBus->released );
+    pthread_mutex_destroy( &pBus->lock );
+}
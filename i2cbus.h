@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+//  File: 	i2cbus.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Arbiter for the I2C bus that the OLED display (0x3C) and the fan and leds
+//  of the Smart Cooling Hat (0x0d) share. The bus owns the only handle on
+//  the adapter; every transfer carries its slave address, so no address
+//  switching is needed between the devices.
+//
+//  Transfers are serialized with a mutex. A high priority transfer (fan) that
+//  is waiting goes before all waiting low priority ones (display). Transfers
+//  are limited to I2C_BUS_MAXWRITE bytes, so the display sends a frame as a
+//  series of short transfers, and a fan write never waits for more than one
+//  of them (about 3.5 ms at 100 kHz).
+//
+//  The transfers themselves are made by a backend (i2cbackend.h): the
+//  adapter device, wiringPi, or a mock that needs no hardware and can
+//  record every transfer.
+//
+//------------------------------------------------------------------------------
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "i2cbackend.h"
+
+#define I2C_BUS_PATH		"/dev/i2c-1"
+#define I2C_BUS_MAXWRITE 	33	// bytes per transfer, control byte included
+
+typedef enum I2cPriority
+{
+    I2cPrioHigh =	0,	// fan and leds
+    I2cPrioLow =	1	// display
+} I2cPriority;
+
+typedef struct I2cBus
+{
+    const I2cBackend*	pBackend;	// NULL when closed
+    int			fd;		// adapter of the i2c backend, or -1
+    int			nDevices;	// handles of the wiringPi backend
+    unsigned int	deviceAddrs	[ I2C_BACKEND_MAX_DEVICES ];
+    int			deviceFds	[ I2C_BACKEND_MAX_DEVICES ];
+    const char*		pDevicePath;	// adapter for wiringPi, or NULL
+    FILE*		pRecord;	// record of the mock backend, or NULL
+    long long		(*pClockUs)( void ); // time of the record, or NULL
+    pthread_mutex_t	lock;
+    pthread_cond_t	released;	// signaled when the bus becomes free
+    bool		bBusy;		// a transfer is in progress
+    int			nHighWaiting;	// high priority transfers waiting
+    unsigned long	nTransfers;
+    unsigned long	nErrors;
+    unsigned long	nBytes;		// written in successful transfers
+} I2cBus;
+
+int	i2cBusOpen( I2cBus* pBus, const I2cBackend* pBackend,
+		    const char* pPath );
+bool	i2cBusIsOpen( const I2cBus* pBus );
+void	i2cBusSetClock( I2cBus* pBus, long long (*pClockUs)( void ));
+int	i2cBusWrite( I2cBus* pBus, I2cPriority priority, unsigned int i2caddr,
+		     const void* pData, int len );
+void	i2cBusCounters( I2cBus* pBus, unsigned long* pnTransfers,
+			unsigned long* pnErrors );
+void	i2cBusClose( I2cBus* pBus );
+
+#endif
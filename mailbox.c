@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+//  File: 	mailbox.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Triple buffer mailbox, see mailbox.h.
+//
+//  The three slots are always owned one each by the producer (back), the
+//  consumer (front) and the mailbox (middle). The exchange on middle hands
+//  a slot over; its acquire/release ordering makes the slot contents visible
+//  to the side that receives it.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <sys/eventfd.h>
+
+#include "mailbox.h"
+
+#define MAILBOX_FRESH 	0x4	// flag in middle: published, not yet taken
+#define MAILBOX_INDEX 	0x3
+
+
+//------------------------------------------------------------------------------
+//  int mailboxInit( Mailbox* pMailbox, size_t size )
+//	Set up a mailbox for values of size bytes.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int mailboxInit( Mailbox* pMailbox, size_t size )
+{
+    pMailbox->size = size;
+    pMailbox->back = 0;
+    atomic_init( &pMailbox->middle, 1 );
+    pMailbox->front = 2;
+    pMailbox->bHaveValue = false;
+
+    pMailbox->pSlots = calloc( 3, size );
+    pMailbox->eventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( pMailbox->pSlots == NULL || pMailbox->eventFd < 0 )
+    {
+	fprintf( stderr, "Could not create mailbox\n" );
+	mailboxClose( pMailbox );
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void* mailboxBack( Mailbox* pMailbox )
+//	Producer: returns the slot to fill before mailboxPublish. Its contents
+//	are stale, not the last published value.
+//------------------------------------------------------------------------------
+void* mailboxBack( Mailbox* pMailbox )
+{
+    return pMailbox->pSlots + pMailbox->back * pMailbox->size;
+}
+
+
+//------------------------------------------------------------------------------
+//  void mailboxPublish( Mailbox* pMailbox )
+//	Producer: make the filled slot the latest value and wake the consumer.
+//------------------------------------------------------------------------------
+void mailboxPublish( Mailbox* pMailbox )
+{
+    uint64_t	one = 1;
+    unsigned int previous = atomic_exchange_explicit( &pMailbox->middle,
+					pMailbox->back | MAILBOX_FRESH,
+					memory_order_acq_rel );
+
+    pMailbox->back = previous & MAILBOX_INDEX;
+
+    // Non-blocking; if the counter is saturated the consumer is awake anyway
+    if ( write( pMailbox->eventFd, &one, sizeof( one )) != sizeof( one ))
+    {
+	return;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  const void* mailboxLatest( Mailbox* pMailbox, bool* pbFresh )
+//	Consumer: take the latest published value. *pbFresh (if not NULL) is
+//	set to whether it was published since the previous call.
+//	Returns the value, which stays valid until the next call, or NULL if
+//	nothing was published yet
+//------------------------------------------------------------------------------
+const void* mailboxLatest( Mailbox* pMailbox, bool* pbFresh )
+{
+    bool bFresh = false;
+
+    if ( atomic_load_explicit( &pMailbox->middle, memory_order_relaxed ) &
+	 MAILBOX_FRESH )
+    {
+	unsigned int previous = atomic_exchange_explicit( &pMailbox->middle,
+						pMailbox->front,
+						memory_order_acq_rel );
+	pMailbox->front = previous & MAILBOX_INDEX;
+	pMailbox->bHaveValue = true;
+	bFresh = true;
+    }
+
+    if ( pbFresh != NULL )
+    {
+	*pbFresh = bFresh;
+    }
+    return pMailbox->bHaveValue ?
+	   pMailbox->pSlots + pMailbox->front * pMailbox->size : NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  int mailboxWait( Mailbox* pMailbox, int timeoutMs )
+//	Consumer: wait until a value is published, for at most timeoutMs
+//	milliseconds (-1 waits forever).
+//	Returns 1 if a value was published, 0 on timeout, -1 on error
+//------------------------------------------------------------------------------
+int mailboxWait( Mailbox* pMailbox, int timeoutMs )
+{
+    struct pollfd	pollFd = { pMailbox->eventFd, POLLIN, 0 };
+    uint64_t		count;
+    int			nReady = poll( &pollFd, 1, timeoutMs );
+
+    if ( nReady <= 0 )
+    {
+	return nReady;
+    }
+    return read( pMailbox->eventFd, &count, sizeof( count )) ==
+	   sizeof( count ) ? 1 : -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  void mailboxClose( Mailbox* pMailbox )
+//	Release the slots and the eventfd.
+//------------------------------------------------------------------------------
+void mailboxClose( Mailbox* pMailbox )
+{
+    free( pMailbox->pSlots );
+    pMailbox->pSlots = NULL;
+    if ( pMailbox->eventFd >= 0 )
+    {
+	close( pMailbox->eventFd );
+	pMailbox->eventFd = -1;
+    }
+}
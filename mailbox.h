@@ -0,0 +1,43 @@
+//------------------------------------------------------------------------------
+//  File: 	mailbox.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Single producer, single consumer "latest value" mailbox between threads.
+//  It is a triple buffer: the producer fills its own slot and swaps it with
+//  the shared middle slot in one atomic exchange, and the consumer swaps the
+//  middle slot with its own slot when it holds a newer value. Neither side
+//  ever waits for the other; a value that was not taken before the next one
+//  was published is simply overwritten.
+//
+//  The consumer can block until a value is published: publishing also bumps
+//  an eventfd, which never blocks the producer.
+//
+//------------------------------------------------------------------------------
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef struct Mailbox
+{
+    size_t		size;		// bytes per slot
+    unsigned char*	pSlots;		// 3 slots
+    atomic_uint		middle;		// slot index, MAILBOX_FRESH if unread
+    unsigned int	back;		// slot of the producer
+    unsigned int	front;		// slot of the consumer
+    bool		bHaveValue;	// front holds a published value
+    int			eventFd;
+} Mailbox;
+
+int		mailboxInit( Mailbox* pMailbox, size_t size );
+void*		mailboxBack( Mailbox* pMailbox );
+void		mailboxPublish( Mailbox* pMailbox );
+const void*	mailboxLatest( Mailbox* pMailbox, bool* pbFresh );
+int		mailboxWait( Mailbox* pMailbox, int timeoutMs );
+void		mailboxClose( Mailbox* pMailbox );
+
+#endif
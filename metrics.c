@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+//  File: 	metrics.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Cache of slowly changing system properties, see metrics.h.
+//
+//  The interface list returned by getifaddrs() is walked with a separate
+//  cursor and released with freeifaddrs() on every refresh, so refreshing
+//  the IP address does not leak memory.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/vfs.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "metrics.h"
+
+
+//------------------------------------------------------------------------------
+//  static int openNetlink()
+//	Open a netlink socket that receives IPv4 address changes.
+//	Returns the socket, or -1 if it could not be opened
+//------------------------------------------------------------------------------
+static int openNetlink()
+{
+    struct sockaddr_nl	address;
+    int 		fd;
+
+    fd = socket( AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		 NETLINK_ROUTE );
+    if ( fd < 0 )
+    {
+	return -1;
+    }
+
+    memset( &address, 0, sizeof( address ));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_IPV4_IFADDR;
+    if ( bind( fd, (struct sockaddr*)&address, sizeof( address )) != 0 )
+    {
+	close( fd );
+	return -1;
+    }
+    return fd;
+}
+
+
+//------------------------------------------------------------------------------
+//  int metricsInit( Metrics* pMetrics )
+//	Open the netlink socket and fill the cache for the first time.
+//	If no netlink socket is available, netlinkFd is -1 and the owner has
+//	to call metricsRefreshIp itself.
+//	Returns 0 on success, -1 if a property could not be retrieved
+//------------------------------------------------------------------------------
+int metricsInit( Metrics* pMetrics )
+{
+    int returnValue = 0;
+
+    memset( pMetrics, 0, sizeof( *pMetrics ));
+
+    pMetrics->netlinkFd = openNetlink();
+    if ( pMetrics->netlinkFd < 0 )
+    {
+	fprintf( stderr, "No netlink socket, IP address is polled\n" );
+    }
+
+    if ( metricsRefreshDisk( pMetrics ) != 0 )
+    {
+	returnValue = -1;
+    }
+    if ( metricsRefreshIp( pMetrics ) != 0 )
+    {
+	returnValue = -1;
+    }
+    return returnValue;
+}
+
+
+//------------------------------------------------------------------------------
+//  int metricsRefreshDisk( Metrics* pMetrics )
+//	Retrieve total and free space of the root file system.
+//	Returns 0 on success, -1 otherwise; the old values are kept on failure
+//------------------------------------------------------------------------------
+int metricsRefreshDisk( Metrics* pMetrics )
+{
+    struct statfs 	diskInfo;
+
+    if ( statfs( "/", &diskInfo ) != 0 )
+    {
+	return -1;
+    }
+
+    unsigned long long blockSize = 	diskInfo.f_bsize;
+    pMetrics->mbTotalDisk = (blockSize * diskInfo.f_blocks) >> 20;
+    pMetrics->mbFreeDisk =  (blockSize * diskInfo.f_bfree) >> 20;
+    snprintf( pMetrics->diskInfoTxt, METRICS_TEXT_SIZE, "Disk:%lu/%luMB",
+	      pMetrics->mbFreeDisk, pMetrics->mbTotalDisk );
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int metricsRefreshIp( Metrics* pMetrics )
+//	Look up the IPv4 address of interface "eth0" or, if that has none,
+//	"wlan0".
+//	Returns 0 on success, -1 if the interface list could not be retrieved
+//------------------------------------------------------------------------------
+int metricsRefreshIp( Metrics* pMetrics )
+{
+    struct ifaddrs*	pIfAddrList = NULL;
+    struct ifaddrs*	pIfAddr;
+    struct ifaddrs*	pFound = NULL;
+    char 		addressBuffer	[INET_ADDRSTRLEN];
+
+    if ( getifaddrs( &pIfAddrList ) != 0 )
+    {
+	return -1;
+    }
+
+    for ( pIfAddr = pIfAddrList; pIfAddr != NULL; pIfAddr = pIfAddr->ifa_next )
+    {
+	if ( pIfAddr->ifa_addr == NULL ||
+	     pIfAddr->ifa_addr->sa_family != AF_INET )
+	{
+	    continue;
+	}
+
+	if ( strcmp( pIfAddr->ifa_name, "eth0" ) == 0 )
+	{
+	    pFound = pIfAddr;
+	    break;
+	}
+	else if ( strcmp( pIfAddr->ifa_name, "wlan0" ) == 0 && pFound == NULL )
+	{
+	    pFound = pIfAddr;
+	}
+    }
+
+    pMetrics->bHaveIp = (pFound != NULL);
+    if ( pFound != NULL )
+    {
+	struct sockaddr_in* pSockAddress = (struct sockaddr_in*)pFound->ifa_addr;
+
+	pMetrics->ipAddress = pSockAddress->sin_addr;
+	snprintf( pMetrics->ifName, sizeof( pMetrics->ifName ), "%s",
+		  pFound->ifa_name );
+	inet_ntop( AF_INET, &pMetrics->ipAddress, addressBuffer,
+		   INET_ADDRSTRLEN );
+
+	if ( strcmp( pFound->ifa_name, "eth0" ) == 0 )
+	{
+	    snprintf( pMetrics->ipInfoTxt, METRICS_TEXT_SIZE, "eth0:IP:%s",
+		      addressBuffer );
+	}
+	else
+	{
+	    snprintf( pMetrics->ipInfoTxt, METRICS_TEXT_SIZE, "wlan0:%s",
+		      addressBuffer );
+	}
+    }
+    else
+    {
+	pMetrics->ifName[ 0 ] = '\0';
+	snprintf( pMetrics->ipInfoTxt, METRICS_TEXT_SIZE, "IP:none" );
+    }
+
+    freeifaddrs( pIfAddrList );
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void metricsOnNetlink( void* pArg )
+//	Scheduler callback for the netlink socket; pArg is the Metrics.
+//	Drains all pending notifications and refreshes the IP address once if
+//	any of them added or removed an address.
+//------------------------------------------------------------------------------
+void metricsOnNetlink( void* pArg )
+{
+    Metrics*	pMetrics = pArg;
+    char	buf[ 4096 ] __attribute__(( aligned( 4 )));
+    bool	bChanged = false;
+    ssize_t	len;
+
+    while ( true )
+    {
+	len = recv( pMetrics->netlinkFd, buf, sizeof( buf ), 0 );
+	if ( len < 0 )
+	{
+	    if ( errno == ENOBUFS )
+	    {
+		// Notifications were dropped: assume something changed
+		bChanged = true;
+		continue;
+	    }
+	    break;	// EAGAIN: all pending messages read
+	}
+
+	struct nlmsghdr* pHeader = (struct nlmsghdr*)buf;
+	for ( ; NLMSG_OK( pHeader, (unsigned int)len );
+	      pHeader = NLMSG_NEXT( pHeader, len ))
+	{
+	    if ( pHeader->nlmsg_type == RTM_NEWADDR ||
+		 pHeader->nlmsg_type == RTM_DELADDR )
+	    {
+		bChanged = true;
+	    }
+	}
+    }
+
+    if ( bChanged )
+    {
+	metricsRefreshIp( pMetrics );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void metricsClose( Metrics* pMetrics )
+//	Release the netlink socket.
+//------------------------------------------------------------------------------
+void metricsClose( Metrics* pMetrics )
+{
+    if ( pMetrics->netlinkFd >= 0 )
+    {
+	close( pMetrics->netlinkFd );
+	pMetrics->netlinkFd = -1;
+    }
+}
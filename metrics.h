@@ -0,0 +1,44 @@
+//------------------------------------------------------------------------------
+//  File: 	metrics.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Cache of the slowly changing system properties shown on the OLED display:
+//  disk space of the root file system and the IP address of eth0 or wlan0.
+//  Disk space is refreshed on request (on a slow cadence). The IP address is
+//  refreshed when the kernel reports an address change on a netlink socket,
+//  which the owner adds to its event loop.
+//
+//------------------------------------------------------------------------------
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#define METRICS_TEXT_SIZE 	64	// "Disk:" with two full %lu values
+
+typedef struct Metrics
+{
+    int			netlinkFd;	// address change notifications, or -1
+
+    // Root file system
+    unsigned long	mbTotalDisk;
+    unsigned long	mbFreeDisk;
+    char		diskInfoTxt	[ METRICS_TEXT_SIZE ];
+
+    // IPv4 address of eth0, or else wlan0
+    bool		bHaveIp;
+    char		ifName		[ 8 ];
+    struct in_addr	ipAddress;
+    char		ipInfoTxt	[ METRICS_TEXT_SIZE ];
+} Metrics;
+
+int	metricsInit( Metrics* pMetrics );
+int	metricsRefreshDisk( Metrics* pMetrics );
+int	metricsRefreshIp( Metrics* pMetrics );
+void	metricsOnNetlink( void* pArg );
+void	metricsClose( Metrics* pMetrics );
+
+#endif
@@ -263,4 +263,41 @@ static const unsigned char font[] PROGMEM = {
 	0x00, 0x00, 0x00, 0x00, 0x00
 };
 
+// Pre-scaled font columns for text sizes 2 and 3. Entry b holds font
+// column byte b with every bit repeated size times, which is the column
+// scaled vertically in display page layout (LSB on top). The tables are
+// built by the preprocessor and only compiled in for the scale factors
+// enabled in ssd1306_i2c.h.
+#define FONT_SPREAD4(f, n)	f(n), f((n) + 1), f((n) + 2), f((n) + 3)
+#define FONT_SPREAD16(f, n)	FONT_SPREAD4(f, n), FONT_SPREAD4(f, (n) + 4), \
+				FONT_SPREAD4(f, (n) + 8), FONT_SPREAD4(f, (n) + 12)
+#define FONT_SPREAD64(f, n)	FONT_SPREAD16(f, n), FONT_SPREAD16(f, (n) + 16), \
+				FONT_SPREAD16(f, (n) + 32), FONT_SPREAD16(f, (n) + 48)
+#define FONT_SPREAD256(f)	FONT_SPREAD64(f, 0), FONT_SPREAD64(f, 64), \
+				FONT_SPREAD64(f, 128), FONT_SPREAD64(f, 192)
+
+#if defined SSD1306_FONT_X2
+// bit k of b becomes bits 2k and 2k+1
+#define FONT_X2(b)	(((b) & 0x01) * 0x0003 | ((b) & 0x02) * 0x0006 | \
+			 ((b) & 0x04) * 0x000C | ((b) & 0x08) * 0x0018 | \
+			 ((b) & 0x10) * 0x0030 | ((b) & 0x20) * 0x0060 | \
+			 ((b) & 0x40) * 0x00C0 | ((b) & 0x80) * 0x0180)
+
+static const unsigned short font_x2[256] PROGMEM = {
+	FONT_SPREAD256(FONT_X2)
+};
+#endif
+
+#if defined SSD1306_FONT_X3
+// bit k of b becomes bits 3k to 3k+2
+#define FONT_X3(b)	(((b) & 0x01) * 0x000007UL | ((b) & 0x02) * 0x00001CUL | \
+			 ((b) & 0x04) * 0x000070UL | ((b) & 0x08) * 0x0001C0UL | \
+			 ((b) & 0x10) * 0x000700UL | ((b) & 0x20) * 0x001C00UL | \
+			 ((b) & 0x40) * 0x007000UL | ((b) & 0x80) * 0x01C000UL)
+
+static const unsigned long font_x3[256] PROGMEM = {
+	FONT_SPREAD256(FONT_X3)
+};
+#endif
+
 #endif
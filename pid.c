@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+//  File: 	pid.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  PID fan controller, see pid.h.
+//
+//  The error is the temperature above the setpoint, so a positive output
+//  means cooling. The derivative acts on the measured temperature instead of
+//  the error, so a change of the setpoint does not kick the fan. Windup is
+//  prevented by not integrating while the output is saturated in the
+//  direction of the error, and by keeping the integral term within 0..1.
+//
+//------------------------------------------------------------------------------
+#include <string.h>
+
+#include "pid.h"
+
+// Duty steps of the fan register: step k is k * 10% of full speed
+#define PID_STEPS 		10
+#define PID_STEP_HYSTERESIS 	0.04	// duty, before leaving the current step
+
+
+//------------------------------------------------------------------------------
+//  static double clampDuty( double duty )
+//	Returns duty limited to 0..1
+//------------------------------------------------------------------------------
+static double clampDuty( double duty )
+{
+    return duty < 0.0 ? 0.0 : (duty > 1.0 ? 1.0 : duty);
+}
+
+
+//------------------------------------------------------------------------------
+//  void pidInit( FanPid* pPid, double setpoint, double kp, double ki,
+//		  double kd )
+//	Set the setpoint and gains and reset the controller.
+//------------------------------------------------------------------------------
+void pidInit( FanPid* pPid, double setpoint, double kp, double ki, double kd )
+{
+    memset( pPid, 0, sizeof( *pPid ));
+    pPid->setpoint = setpoint;
+    pPid->kp = kp;
+    pPid->ki = ki;
+    pPid->kd = kd;
+}
+
+
+//------------------------------------------------------------------------------
+//  void pidReset( FanPid* pPid )
+//	Forget the integral and the previous sample.
+//------------------------------------------------------------------------------
+void pidReset( FanPid* pPid )
+{
+    pPid->integral = 0.0;
+    pPid->bStarted = false;
+    pPid->duty = 0.0;
+}
+
+
+//------------------------------------------------------------------------------
+//  double pidUpdate( FanPid* pPid, double temperature, long long nowMs )
+//	Run the controller on a temperature sample (degrees Celsius) taken at
+//	monotonic time nowMs.
+//	Returns the fan duty, 0..1
+//------------------------------------------------------------------------------
+double pidUpdate( FanPid* pPid, double temperature, long long nowMs )
+{
+    double error = temperature - pPid->setpoint;
+    double derivative = 0.0;
+    double dt = 0.0;
+
+    if ( pPid->bStarted && nowMs > pPid->lastMs )
+    {
+	dt = (nowMs - pPid->lastMs) / 1000.0;
+	derivative = (temperature - pPid->lastTemperature) / dt;
+    }
+    pPid->lastTemperature = temperature;
+    pPid->lastMs = nowMs;
+    pPid->bStarted = true;
+
+    double proportional = pPid->kp * error + pPid->kd * derivative;
+    double unclamped = proportional + pPid->integral;
+
+    // Conditional integration: only if that does not drive the output
+    // further into saturation
+    if ( !(unclamped >= 1.0 && error > 0.0) &&
+	 !(unclamped <= 0.0 && error < 0.0) )
+    {
+	pPid->integral = clampDuty( pPid->integral + pPid->ki * error * dt );
+    }
+
+    pPid->duty = clampDuty( proportional + pPid->integral );
+    return pPid->duty;
+}
+
+
+//------------------------------------------------------------------------------
+//  unsigned char pidFanValue( double duty, unsigned char current )
+//	Quantize duty (0..1) to a fan register value: 0x00 off, 0x02..0x09 is
+//	20%..90% and 0x01 full speed; 10% is not available and rounds to off
+//	or 20%. The current register value is kept unless duty moved beyond
+//	its rounding interval by a small margin, so noise on the temperature
+//	does not toggle the fan between two steps.
+//	Returns the register value
+//------------------------------------------------------------------------------
+unsigned char pidFanValue( double duty, unsigned char current )
+{
+    int currentStep = (current == 0x01) ? PID_STEPS : current;
+    int step = (int)(clampDuty( duty ) * PID_STEPS + 0.5);
+
+    if ( step == 1 )
+    {
+	step = (duty < 0.15) ? 0 : 2;
+    }
+
+    if ( currentStep <= PID_STEPS && step != currentStep )
+    {
+	double lowBound = (currentStep == 2 ? 0.15 : (currentStep - 0.5) /
+			   PID_STEPS) - PID_STEP_HYSTERESIS;
+	double highBound = (currentStep + 0.5) / PID_STEPS + PID_STEP_HYSTERESIS;
+
+	if ( currentStep == 0 )
+	{
+	    lowBound = 0.0;
+	    highBound = 0.15 + PID_STEP_HYSTERESIS;
+	}
+	if ( duty > lowBound && duty < highBound )
+	{
+	    step = currentStep;
+	}
+    }
+
+    return (step == PID_STEPS) ? 0x01 : (unsigned char)step;
+}
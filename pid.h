@@ -0,0 +1,36 @@
+//------------------------------------------------------------------------------
+//  File: 	pid.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  PID controller for the fan. The controller output is a fan duty between 0
+//  (off) and 1 (full speed), which is quantized to the steps of the fan
+//  register of the Smart Cooling Hat: off, 20%..90% and full speed.
+//
+//------------------------------------------------------------------------------
+#ifndef PID_H
+#define PID_H
+
+#include <stdbool.h>
+
+typedef struct FanPid
+{
+    double	setpoint;	// degrees Celsius
+    double	kp;		// duty per degree Celsius
+    double	ki;		// duty per degree Celsius per second
+    double	kd;		// duty per degree Celsius per second of change
+    double	integral;	// integral term, in duty
+    double	lastTemperature;
+    long long	lastMs;
+    bool	bStarted;	// lastTemperature and lastMs are valid
+    double	duty;		// last output
+} FanPid;
+
+void		pidInit( FanPid* pPid, double setpoint, double kp, double ki,
+			 double kd );
+void		pidReset( FanPid* pPid );
+double		pidUpdate( FanPid* pPid, double temperature, long long nowMs );
+unsigned char	pidFanValue( double duty, unsigned char current );
+
+#endif
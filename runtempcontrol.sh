@@ -10,11 +10,24 @@
 #	executable crashes after a number of hours.
 #	The task of this script is to start a new instance of tempcontrol and
 #	log the event to /var/log/tempcontrol.log
+#	On systems with systemd, use tempcontrol.service instead: it also
+#	restarts tempcontrol when the control loop hangs.
 #-------------------------------------------------------------------------------
 tempControlLogFile="/var/log/tempcontrol.log"
 
-# Remove previous instance of log file: /usr/bin
-rm -f $tempControlLogFile
+# Binary sample log (tempcontrol -l), empty for none:
+tempControlSampleLog=""
+tempControlOptions=""
+if [ -n "$tempControlSampleLog" ]
+then
+    tempControlOptions="-l $tempControlSampleLog"
+fi
+
+# Keep the log of the previous boot
+if [ -f $tempControlLogFile ]
+then
+    mv -f $tempControlLogFile $tempControlLogFile.1
+fi
 
 # No write access to group and others:
 umask 022
@@ -23,7 +36,11 @@ while [ 1 ]
 do
     timedate=`date +%y-%m-%d\ %H:%M`
     echo "$timedate: Starting tempcontrol executable" >> $tempControlLogFile
-    tempcontrol 2>> $tempControlLogFile
+    tempcontrol $tempControlOptions 2>> $tempControlLogFile
+
+    # Nothing controls the fan until the next instance runs
+    tempcontrol -t fanFull 2>> $tempControlLogFile
+    sleep 1
 done
 exit 0
 
@@ -0,0 +1,310 @@
+//------------------------------------------------------------------------------
+//  File: 	samplelog.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Memory mapped sample log, see samplelog.h.
+//
+//  The file gets its full size with posix_fallocate when it is created, so
+//  the blocks exist before the mapping is written and a full card shows up
+//  at startup instead of as a SIGBUS later on. An existing log with the
+//  same layout is continued after a restart.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "samplelog.h"
+
+
+//------------------------------------------------------------------------------
+//  static bool sampleLogValid( const SampleLog* pLog, uint32_t capacity )
+//	Returns whether the mapped file is a log of this layout and capacity
+//------------------------------------------------------------------------------
+static bool sampleLogValid( const SampleLog* pLog, uint32_t capacity )
+{
+    const SampleLogHeader* pHeader = pLog->pHeader;
+
+    return memcmp( pHeader->magic, SAMPLELOG_MAGIC,
+		   sizeof( SAMPLELOG_MAGIC )) == 0 &&
+	   pHeader->version == SAMPLELOG_VERSION &&
+	   pHeader->headerSize == SAMPLELOG_HEADER_SIZE &&
+	   pHeader->recordSize == sizeof( HistoryRecord ) &&
+	   pHeader->capacity == capacity &&
+	   pHeader->zones == HISTORY_ZONES &&
+	   pHeader->count <= capacity;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int sampleLogMap( SampleLog* pLog, uint32_t capacity,
+//			     uint32_t sequence )
+//	Open and map pLog->pPath, continuing the log in it if it has the right
+//	layout, or else starting a new log with the given sequence number.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int sampleLogMap( SampleLog* pLog, uint32_t capacity, uint32_t sequence )
+{
+    struct stat	fileStat;
+    bool	bExisting;
+
+    pLog->size = SAMPLELOG_HEADER_SIZE +
+		 (size_t)capacity * sizeof( HistoryRecord );
+    pLog->fd = open( pLog->pPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+    if ( pLog->fd < 0 || fstat( pLog->fd, &fileStat ) != 0 )
+    {
+	perror( pLog->pPath );
+	return -1;
+    }
+
+    bExisting = ((size_t)fileStat.st_size == pLog->size);
+    if ( !bExisting &&
+	 (ftruncate( pLog->fd, 0 ) != 0 ||
+	  posix_fallocate( pLog->fd, 0, pLog->size ) != 0 ))
+    {
+	fprintf( stderr, "%s: could not allocate %zu bytes\n", pLog->pPath,
+		 pLog->size );
+	return -1;
+    }
+
+    pLog->pBase = mmap( NULL, pLog->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			pLog->fd, 0 );
+    if ( pLog->pBase == MAP_FAILED )
+    {
+	pLog->pBase = NULL;
+	perror( pLog->pPath );
+	return -1;
+    }
+    pLog->pHeader = (SampleLogHeader*)pLog->pBase;
+    pLog->pRecords = (HistoryRecord*)(pLog->pBase + SAMPLELOG_HEADER_SIZE);
+
+    if ( !bExisting || !sampleLogValid( pLog, capacity ))
+    {
+	memset( pLog->pBase, 0, SAMPLELOG_HEADER_SIZE );
+	memcpy( pLog->pHeader->magic, SAMPLELOG_MAGIC,
+		sizeof( SAMPLELOG_MAGIC ));
+	pLog->pHeader->version = SAMPLELOG_VERSION;
+	pLog->pHeader->headerSize = SAMPLELOG_HEADER_SIZE;
+	pLog->pHeader->recordSize = sizeof( HistoryRecord );
+	pLog->pHeader->capacity = capacity;
+	pLog->pHeader->zones = HISTORY_ZONES;
+	pLog->pHeader->sequence = sequence;
+	pLog->pHeader->count = 0;
+	msync( pLog->pBase, SAMPLELOG_HEADER_SIZE, MS_SYNC );
+    }
+    pLog->syncedCount = pLog->pHeader->count;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void sampleLogUnmap( SampleLog* pLog )
+//	Release the mapping and the file.
+//------------------------------------------------------------------------------
+static void sampleLogUnmap( SampleLog* pLog )
+{
+    if ( pLog->pBase != NULL )
+    {
+	munmap( pLog->pBase, pLog->size );
+	pLog->pBase = NULL;
+    }
+    pLog->pHeader = NULL;
+    pLog->pRecords = NULL;
+    if ( pLog->fd >= 0 )
+    {
+	close( pLog->fd );
+	pLog->fd = -1;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  int sampleLogOpen( SampleLog* pLog, const char* pPath, uint32_t capacity )
+//	Open the log file pPath for capacity records. pPath must stay valid
+//	while the log is open.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int sampleLogOpen( SampleLog* pLog, const char* pPath, uint32_t capacity )
+{
+    memset( pLog, 0, sizeof( *pLog ));
+    pLog->pPath = pPath;
+    pLog->fd = -1;
+
+    if ( capacity == 0 || sampleLogMap( pLog, capacity, 0 ) != 0 )
+    {
+	sampleLogUnmap( pLog );
+	return -1;
+    }
+    fprintf( stderr, "Logging samples to %s (%llu of %u records)\n", pPath,
+	     (unsigned long long)pLog->pHeader->count, capacity );
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int sampleLogRotate( SampleLog* pLog )
+//	Flush the full log, rename it to <path>.1, replacing an older one, and
+//	start a new log.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int sampleLogRotate( SampleLog* pLog )
+{
+    char	oldPath	[ 512 ];
+    uint32_t	capacity = pLog->pHeader->capacity;
+    uint32_t	sequence = pLog->pHeader->sequence + 1;
+
+    sampleLogSync( pLog );
+    sampleLogUnmap( pLog );
+
+    snprintf( oldPath, sizeof( oldPath ), "%s.1", pLog->pPath );
+    if ( rename( pLog->pPath, oldPath ) != 0 )
+    {
+	perror( oldPath );
+	return -1;
+    }
+
+    if ( sampleLogMap( pLog, capacity, sequence ) != 0 )
+    {
+	sampleLogUnmap( pLog );
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int sampleLogAppend( SampleLog* pLog, const HistoryRecord* pRecord )
+//	Append a record to the log, rotating the file when it is full. The
+//	record reaches the card with the next sampleLogSync, or earlier when
+//	the kernel writes the page back.
+//	Returns 0 on success, -1 if the log is not open
+//------------------------------------------------------------------------------
+int sampleLogAppend( SampleLog* pLog, const HistoryRecord* pRecord )
+{
+    if ( pLog->pHeader == NULL )
+    {
+	return -1;
+    }
+
+    if ( pLog->pHeader->count >= pLog->pHeader->capacity &&
+	 sampleLogRotate( pLog ) != 0 )
+    {
+	fprintf( stderr, "Sample log stopped\n" );
+	return -1;
+    }
+
+    pLog->pRecords[ pLog->pHeader->count ] = *pRecord;
+    pLog->pHeader->count++;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int sampleLogSync( SampleLog* pLog )
+//	Write the records appended since the previous call, and the header,
+//	to the file. Only the pages that hold them are flushed.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int sampleLogSync( SampleLog* pLog )
+{
+    long	pageSize = sysconf( _SC_PAGESIZE );
+    size_t	first;
+    size_t	end;
+
+    if ( pLog->pHeader == NULL )
+    {
+	return -1;
+    }
+    if ( pLog->syncedCount == pLog->pHeader->count )
+    {
+	return 0;
+    }
+
+    first = SAMPLELOG_HEADER_SIZE + pLog->syncedCount * sizeof( HistoryRecord );
+    end = SAMPLELOG_HEADER_SIZE + pLog->pHeader->count * sizeof( HistoryRecord );
+    first -= first % pageSize;
+
+    if ( msync( pLog->pBase + first, end - first, MS_SYNC ) != 0 ||
+	 msync( pLog->pBase, SAMPLELOG_HEADER_SIZE, MS_SYNC ) != 0 )
+    {
+	perror( pLog->pPath );
+	return -1;
+    }
+    pLog->syncedCount = pLog->pHeader->count;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void sampleLogClose( SampleLog* pLog )
+//	Flush and close the log.
+//------------------------------------------------------------------------------
+void sampleLogClose( SampleLog* pLog )
+{
+    sampleLogSync( pLog );
+    sampleLogUnmap( pLog );
+}
+
+
+//------------------------------------------------------------------------------
+//  int sampleLogDump( const char* pPath, FILE* pOut )
+//	Print the records of log file pPath as text, one line per record:
+//	time, control temperature, zone temperatures, fan register, CPU load.
+//	Returns 0 on success, -1 if the file is not a sample log
+//------------------------------------------------------------------------------
+int sampleLogDump( const char* pPath, FILE* pOut )
+{
+    SampleLogHeader	header;
+    HistoryRecord	record;
+    FILE*		pFile = fopen( pPath, "rb" );
+    uint64_t		n;
+    int			i;
+
+    if ( pFile == NULL )
+    {
+	perror( pPath );
+	return -1;
+    }
+
+    if ( fread( &header, sizeof( header ), 1, pFile ) != 1 ||
+	 memcmp( header.magic, SAMPLELOG_MAGIC, sizeof( SAMPLELOG_MAGIC )) != 0 ||
+	 header.recordSize != sizeof( HistoryRecord ) ||
+	 header.zones != HISTORY_ZONES ||
+	 fseek( pFile, header.headerSize, SEEK_SET ) != 0 )
+    {
+	fprintf( stderr, "%s: not a sample log of this version\n", pPath );
+	fclose( pFile );
+	return -1;
+    }
+
+    fprintf( pOut, "# %s: file %u, %llu records\n", pPath, header.sequence,
+	     (unsigned long long)header.count );
+    for ( n = 0; n < header.count &&
+		 fread( &record, sizeof( record ), 1, pFile ) == 1; n++ )
+    {
+	fprintf( pOut, "%u %.2f", record.time, record.temperature / 100.0 );
+	for ( i = 0; i < HISTORY_ZONES; i++ )
+	{
+	    if ( record.zones[ i ] == HISTORY_NO_VALUE )
+	    {
+		fprintf( pOut, " -" );
+	    }
+	    else
+	    {
+		fprintf( pOut, " %.2f", record.zones[ i ] / 100.0 );
+	    }
+	}
+	fprintf( pOut, " %u %u\n", record.fanValue, record.cpuLoad );
+    }
+
+    fclose( pFile );
+    return 0;
+}
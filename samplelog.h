@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+//  File: 	samplelog.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Binary log of samples in a file. The file is preallocated and mapped in
+//  memory, so logging a sample is a copy into the mapping; the pages are
+//  written to the card in batches by sampleLogSync, which is called
+//  periodically. When the file is full, it is renamed to <path>.1 and a new
+//  file is started.
+//
+//  File layout (little endian, as written by the Pi):
+//	SAMPLELOG_HEADER_SIZE bytes with a SampleLogHeader at the start
+//	capacity records of recordSize bytes, of which count are valid;
+//	each record is a HistoryRecord (history.h)
+//
+//------------------------------------------------------------------------------
+#ifndef SAMPLELOG_H
+#define SAMPLELOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "history.h"
+
+#define SAMPLELOG_MAGIC		"TCSLOG1"
+#define SAMPLELOG_VERSION	1
+#define SAMPLELOG_HEADER_SIZE	4096		// one page
+#define SAMPLELOG_CAPACITY	(7 * 86400)	// records, a week at 1 Hz
+#define SAMPLELOG_SYNC_S	60		// flush period
+
+typedef struct SampleLogHeader
+{
+    char	magic	[ 8 ];
+    uint32_t	version;
+    uint32_t	headerSize;	// offset of the first record
+    uint32_t	recordSize;
+    uint32_t	capacity;	// records
+    uint32_t	zones;		// zone temperatures per record
+    uint32_t	sequence;	// number of files rotated before this one
+    uint64_t	count;		// valid records
+} SampleLogHeader;
+
+typedef struct SampleLog
+{
+    const char*		pPath;
+    int			fd;
+    size_t		size;
+    unsigned char*	pBase;		// mapping of the whole file
+    SampleLogHeader*	pHeader;
+    HistoryRecord*	pRecords;
+    uint64_t		syncedCount;	// records flushed by sampleLogSync
+} SampleLog;
+
+int	sampleLogOpen( SampleLog* pLog, const char* pPath, uint32_t capacity );
+int	sampleLogAppend( SampleLog* pLog, const HistoryRecord* pRecord );
+int	sampleLogSync( SampleLog* pLog );
+void	sampleLogClose( SampleLog* pLog );
+int	sampleLogDump( const char* pPath, FILE* pOut );
+
+#endif
@@ -0,0 +1,348 @@
+//------------------------------------------------------------------------------
+//  File: 	scheduler.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Event loop based on timerfd and epoll. A periodic task fires for the first
+//  time right after it is added, and then every periodMs milliseconds. When
+//  the loop falls behind, missed expirations of a timer are collapsed into a
+//  single callback instead of being replayed.
+//  Signals are delivered through a signalfd, so their callbacks run in the
+//  loop like any other task instead of in a signal handler.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+#include "scheduler.h"
+
+
+//------------------------------------------------------------------------------
+//  int schedInit( Scheduler* pSched )
+//	Create the epoll instance of the scheduler.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int schedInit( Scheduler* pSched )
+{
+    memset( pSched, 0, sizeof( *pSched ));
+
+    pSched->epollFd = epoll_create1( EPOLL_CLOEXEC );
+    if ( pSched->epollFd < 0 )
+    {
+	fprintf( stderr, "Could not create epoll instance\n" );
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int schedRegister( Scheduler* pSched, int fd, SchedKind kind,
+//			      SchedCallback callback, void* pArg )
+//	Add fd to the epoll set and remember what to call when it is readable.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int schedRegister( Scheduler* pSched, int fd, SchedKind kind,
+			  SchedCallback callback, void* pArg )
+{
+    struct epoll_event	event;
+    SchedEvent*		pEvent = NULL;
+    int			i;
+
+    // Reuse the slot of a removed fd; the others are referenced by epoll
+    for ( i = 0; i < pSched->nEvents && pEvent == NULL; i++ )
+    {
+	if ( pSched->events[ i ].fd < 0 )
+	{
+	    pEvent = &pSched->events[ i ];
+	}
+    }
+    if ( pEvent == NULL )
+    {
+	if ( pSched->nEvents >= SCHED_MAX_EVENTS )
+	{
+	    fprintf( stderr, "Too many scheduler events\n" );
+	    return -1;
+	}
+	pEvent = &pSched->events[ pSched->nEvents ];
+    }
+    pEvent->fd = fd;
+    pEvent->kind = kind;
+    pEvent->callback = callback;
+    pEvent->pArg = pArg;
+
+    memset( &event, 0, sizeof( event ));
+    event.events = EPOLLIN;
+    event.data.ptr = pEvent;
+    if ( epoll_ctl( pSched->epollFd, EPOLL_CTL_ADD, fd, &event ) != 0 )
+    {
+	fprintf( stderr, "Could not add fd %d to epoll set\n", fd );
+	pEvent->fd = -1;
+	return -1;
+    }
+
+    if ( pEvent == &pSched->events[ pSched->nEvents ] )
+    {
+	pSched->nEvents++;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int schedSetPeriod( Scheduler* pSched, int timerFd, int periodMs )
+//	(Re)arm a timer returned by schedAddTimer. The timer fires right away
+//	and then every periodMs milliseconds.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int schedSetPeriod( Scheduler* pSched, int timerFd, int periodMs )
+{
+    struct itimerspec	spec;
+
+    (void) pSched;
+    if ( periodMs <= 0 )
+    {
+	return -1;
+    }
+
+    spec.it_interval.tv_sec = periodMs / 1000;
+    spec.it_interval.tv_nsec = (periodMs % 1000) * 1000000L;
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 1;	// first expiry as soon as possible
+
+    return timerfd_settime( timerFd, 0, &spec, NULL ) == 0 ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  int schedAddTimer( Scheduler* pSched, int periodMs,
+//		       SchedCallback callback, void* pArg )
+//	Run callback( pArg ) every periodMs milliseconds.
+//	Returns the timer fd, which can be passed to schedSetPeriod, or -1
+//------------------------------------------------------------------------------
+int schedAddTimer( Scheduler* pSched, int periodMs,
+		   SchedCallback callback, void* pArg )
+{
+    int timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+    if ( timerFd < 0 )
+    {
+	fprintf( stderr, "Could not create timer\n" );
+	return -1;
+    }
+
+    if ( schedSetPeriod( pSched, timerFd, periodMs ) != 0 ||
+	 schedRegister( pSched, timerFd, SchedTimer, callback, pArg ) != 0 )
+    {
+	close( timerFd );
+	return -1;
+    }
+    return timerFd;
+}
+
+
+//------------------------------------------------------------------------------
+//  int schedAddFd( Scheduler* pSched, int fd,
+//		    SchedCallback callback, void* pArg )
+//	Run callback( pArg ) whenever fd becomes readable. The callback has to
+//	consume the data, and the fd stays owned by the caller.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int schedAddFd( Scheduler* pSched, int fd, SchedCallback callback, void* pArg )
+{
+    return schedRegister( pSched, fd, SchedFd, callback, pArg );
+}
+
+
+//------------------------------------------------------------------------------
+//  void schedRemoveFd( Scheduler* pSched, int fd )
+//	Stop watching an fd added with schedAddFd; it can be closed afterwards.
+//	Can be called from a callback, also for the fd of that callback.
+//------------------------------------------------------------------------------
+void schedRemoveFd( Scheduler* pSched, int fd )
+{
+    int i;
+
+    for ( i = 0; i < pSched->nEvents; i++ )
+    {
+	SchedEvent* pEvent = &pSched->events[ i ];
+
+	if ( pEvent->fd == fd && pEvent->kind == SchedFd )
+	{
+	    epoll_ctl( pSched->epollFd, EPOLL_CTL_DEL, fd, NULL );
+	    pEvent->fd = -1;
+	    pEvent->callback = NULL;
+	    return;
+	}
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  int schedAddSignal( Scheduler* pSched, int signo,
+//			SchedCallback callback, void* pArg )
+//	Run callback( pArg ) whenever signal signo is received. The signal is
+//	blocked for the calling thread, so it is only delivered to the loop;
+//	call this before other threads are started so they inherit the mask.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int schedAddSignal( Scheduler* pSched, int signo,
+		    SchedCallback callback, void* pArg )
+{
+    sigset_t	mask;
+    int		signalFd;
+
+    sigemptyset( &mask );
+    sigaddset( &mask, signo );
+    if ( sigprocmask( SIG_BLOCK, &mask, NULL ) != 0 )
+    {
+	fprintf( stderr, "Could not block signal %d\n", signo );
+	return -1;
+    }
+
+    signalFd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC );
+    if ( signalFd < 0 )
+    {
+	fprintf( stderr, "Could not create signalfd\n" );
+	return -1;
+    }
+
+    if ( schedRegister( pSched, signalFd, SchedSignal, callback, pArg ) != 0 )
+    {
+	close( signalFd );
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int schedRun( Scheduler* pSched )
+//	Dispatch events until schedStop is called.
+//	Returns 0 after schedStop, -1 if waiting for events failed
+//------------------------------------------------------------------------------
+int schedRun( Scheduler* pSched )
+{
+    struct epoll_event	ready[ SCHED_MAX_EVENTS ];
+    int			i;
+
+    pSched->bRunning = true;
+    while ( pSched->bRunning )
+    {
+	int nReady = epoll_wait( pSched->epollFd, ready, SCHED_MAX_EVENTS, -1 );
+
+	if ( nReady < 0 )
+	{
+	    if ( errno == EINTR )
+	    {
+		continue;
+	    }
+	    fprintf( stderr, "epoll_wait failed\n" );
+	    return -1;
+	}
+
+	for ( i = 0; i < nReady && pSched->bRunning; i++ )
+	{
+	    SchedEvent* pEvent = ready[ i ].data.ptr;
+
+	    if ( pEvent->fd < 0 )
+	    {
+		continue;	// removed by an earlier callback
+	    }
+	    else if ( pEvent->kind == SchedTimer )
+	    {
+		uint64_t expirations;
+
+		// Acknowledge the timer; overruns are not replayed
+		if ( read( pEvent->fd, &expirations, sizeof( expirations ))
+		     != sizeof( expirations ))
+		{
+		    continue;
+		}
+	    }
+	    else if ( pEvent->kind == SchedSignal )
+	    {
+		struct signalfd_siginfo info;
+
+		// Signals of one kind that arrive together are collapsed
+		if ( read( pEvent->fd, &info, sizeof( info )) != sizeof( info ))
+		{
+		    continue;
+		}
+	    }
+	    pEvent->callback( pEvent->pArg );
+	}
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void schedStop( Scheduler* pSched )
+//	Make schedRun return after the callback that is currently running.
+//------------------------------------------------------------------------------
+void schedStop( Scheduler* pSched )
+{
+    pSched->bRunning = false;
+}
+
+
+//------------------------------------------------------------------------------
+//  long long schedNowMs()
+//	Returns the time of the clock the timers run on, in milliseconds
+//------------------------------------------------------------------------------
+long long schedNowMs()
+{
+    struct timespec	now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+//------------------------------------------------------------------------------
+//  long long schedNowUs()
+//	Returns the time of the clock the timers run on, in microseconds
+//------------------------------------------------------------------------------
+long long schedNowUs()
+{
+    struct timespec	now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+//------------------------------------------------------------------------------
+//  void schedClose( Scheduler* pSched )
+//	Close the timers, signalfds and the epoll instance.
+//------------------------------------------------------------------------------
+void schedClose( Scheduler* pSched )
+{
+    int i;
+
+    for ( i = 0; i < pSched->nEvents; i++ )
+    {
+	if ( pSched->events[ i ].kind != SchedFd && pSched->events[ i ].fd >= 0 )
+	{
+	    close( pSched->events[ i ].fd );
+	}
+    }
+    pSched->nEvents = 0;
+
+    if ( pSched->epollFd >= 0 )
+    {
+	close( pSched->epollFd );
+	pSched->epollFd = -1;
+    }
+}
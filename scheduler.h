@@ -0,0 +1,60 @@
+//------------------------------------------------------------------------------
+//  File: 	scheduler.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Minimal event loop for the temperature control daemon. Periodic tasks are
+//  backed by a timerfd each, and all file descriptors are waited for with a
+//  single epoll instance, so every subsystem can run at its own rate and
+//  other event sources (sockets, signals) can be added to the same loop.
+//
+//------------------------------------------------------------------------------
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+
+#define SCHED_MAX_EVENTS 	16
+
+typedef void (*SchedCallback)( void* pArg );
+
+typedef enum SchedKind
+{
+    SchedFd =		0,	// fd owned by the caller
+    SchedTimer =	1,	// timerfd owned by the scheduler
+    SchedSignal =	2	// signalfd owned by the scheduler
+} SchedKind;
+
+typedef struct SchedEvent
+{
+    int			fd;
+    SchedKind		kind;
+    SchedCallback	callback;
+    void*		pArg;
+} SchedEvent;
+
+typedef struct Scheduler
+{
+    int			epollFd;
+    int			nEvents;
+    bool		bRunning;
+    SchedEvent		events[ SCHED_MAX_EVENTS ];
+} Scheduler;
+
+int	schedInit( Scheduler* pSched );
+int	schedAddTimer( Scheduler* pSched, int periodMs,
+		       SchedCallback callback, void* pArg );
+int	schedSetPeriod( Scheduler* pSched, int timerFd, int periodMs );
+int	schedAddFd( Scheduler* pSched, int fd,
+		    SchedCallback callback, void* pArg );
+void	schedRemoveFd( Scheduler* pSched, int fd );
+int	schedAddSignal( Scheduler* pSched, int signo,
+			SchedCallback callback, void* pArg );
+int	schedRun( Scheduler* pSched );
+void	schedStop( Scheduler* pSched );
+void	schedClose( Scheduler* pSched );
+long long schedNowMs();
+long long schedNowUs();
+
+#endif
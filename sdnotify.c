@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+//  File: 	sdnotify.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  systemd notifications, see sdnotify.h.
+//
+//  $NOTIFY_SOCKET is a path, or an abstract socket name when it starts with
+//  '@'. The socket is opened once, so a notification is a single sendto().
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "sdnotify.h"
+
+
+//------------------------------------------------------------------------------
+//  int sdNotifyInit( SdNotify* pNotify )
+//	Open the notification socket of systemd, if there is one.
+//	Returns 0 on success or when not running under systemd, -1 if the
+//	socket of $NOTIFY_SOCKET could not be used
+//------------------------------------------------------------------------------
+int sdNotifyInit( SdNotify* pNotify )
+{
+    const char*	pPath = getenv( "NOTIFY_SOCKET" );
+    size_t	length;
+
+    memset( pNotify, 0, sizeof( *pNotify ));
+    pNotify->fd = -1;
+    if ( pPath == NULL || pPath[ 0 ] == '\0' )
+    {
+	return 0;
+    }
+
+    length = strlen( pPath );
+    if ( (pPath[ 0 ] != '/' && pPath[ 0 ] != '@') ||
+	 length >= sizeof( pNotify->address.sun_path ))
+    {
+	fprintf( stderr, "Invalid NOTIFY_SOCKET %s\n", pPath );
+	return -1;
+    }
+
+    pNotify->address.sun_family = AF_UNIX;
+    memcpy( pNotify->address.sun_path, pPath, length );
+    if ( pPath[ 0 ] == '@' )
+    {
+	pNotify->address.sun_path[ 0 ] = '\0';	// abstract namespace
+    }
+    else
+    {
+	length++;				// with the terminating null
+    }
+    pNotify->addressLength = offsetof( struct sockaddr_un, sun_path ) + length;
+
+    pNotify->fd = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    if ( pNotify->fd < 0 )
+    {
+	perror( "NOTIFY_SOCKET" );
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int sdNotify( SdNotify* pNotify, const char* pState )
+//	Send state pState, e.g. "READY=1", to systemd; nothing is sent when
+//	not running under systemd.
+//	Returns 0 on success, -1 if the notification could not be sent
+//------------------------------------------------------------------------------
+int sdNotify( SdNotify* pNotify, const char* pState )
+{
+    size_t length = strlen( pState );
+
+    if ( pNotify->fd < 0 )
+    {
+	return 0;
+    }
+    if ( sendto( pNotify->fd, pState, length, MSG_NOSIGNAL,
+		 (const struct sockaddr*)&pNotify->address,
+		 pNotify->addressLength ) != (ssize_t)length )
+    {
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  long long sdWatchdogUs()
+//	Returns the watchdog interval of the service in microseconds, or 0 if
+//	there is no watchdog for this process
+//------------------------------------------------------------------------------
+long long sdWatchdogUs()
+{
+    const char*	pUsec = getenv( "WATCHDOG_USEC" );
+    const char*	pPid = getenv( "WATCHDOG_PID" );
+    long long	usec;
+
+    if ( pUsec == NULL ||
+	 (pPid != NULL && atol( pPid ) != (long)getpid()) )
+    {
+	return 0;
+    }
+    usec = atoll( pUsec );
+    return usec > 0 ? usec : 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void sdNotifyClose( SdNotify* pNotify )
+//	Close the notification socket.
+//------------------------------------------------------------------------------
+void sdNotifyClose( SdNotify* pNotify )
+{
+    if ( pNotify->fd >= 0 )
+    {
+	close( pNotify->fd );
+	pNotify->fd = -1;
+    }
+}
@@ -0,0 +1,36 @@
+//------------------------------------------------------------------------------
+//  File: 	sdnotify.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Service notifications to systemd (sd_notify protocol) without libsystemd:
+//  a state string such as "READY=1" or "WATCHDOG=1" is sent as a datagram to
+//  the unix socket in $NOTIFY_SOCKET. When the program does not run as a
+//  systemd service of Type=notify the variable is not set, and
+//  notifications are silently dropped.
+//
+//  The watchdog interval of the service (WatchdogSec=) is passed in
+//  $WATCHDOG_USEC; "WATCHDOG=1" has to be sent well within that interval,
+//  or systemd kills and restarts the service.
+//
+//------------------------------------------------------------------------------
+#ifndef SDNOTIFY_H
+#define SDNOTIFY_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct SdNotify
+{
+    int			fd;		// -1 if not running under systemd
+    struct sockaddr_un	address;
+    socklen_t		addressLength;
+} SdNotify;
+
+int		sdNotifyInit( SdNotify* pNotify );
+int		sdNotify( SdNotify* pNotify, const char* pState );
+long long	sdWatchdogUs();
+void		sdNotifyClose( SdNotify* pNotify );
+
+#endif
@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+//  File: 	simulate.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Simulation trace and statistics, see simulate.h.
+//
+//------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulate.h"
+#include "samplelog.h"
+#include "coolinghat.h"
+
+
+//------------------------------------------------------------------------------
+//  int traceOpen( Trace* pTrace, const char* pPath )
+//	Open trace file pPath, and find out whether it is a sample log.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int traceOpen( Trace* pTrace, const char* pPath )
+{
+    SampleLogHeader header;
+
+    memset( pTrace, 0, sizeof( *pTrace ));
+    pTrace->pPath = pPath;
+    pTrace->pFile = fopen( pPath, "rb" );
+    if ( pTrace->pFile == NULL )
+    {
+	perror( pPath );
+	return -1;
+    }
+
+    if ( fread( &header, sizeof( header ), 1, pTrace->pFile ) == 1 &&
+	 !memcmp( header.magic, SAMPLELOG_MAGIC, sizeof( SAMPLELOG_MAGIC )))
+    {
+	if ( header.recordSize != sizeof( HistoryRecord ) ||
+	     header.zones != HISTORY_ZONES ||
+	     fseek( pTrace->pFile, header.headerSize, SEEK_SET ) != 0 )
+	{
+	    fprintf( stderr, "%s: not a sample log of this version\n", pPath );
+	    traceClose( pTrace );
+	    return -1;
+	}
+	pTrace->bSampleLog = true;
+	pTrace->nRemaining = header.count;
+	return 0;
+    }
+
+    rewind( pTrace->pFile );
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool parseLine( const char* pLine, TraceSample* pSample )
+//	Parse a text line <time>,<temperature>[,<cpu>].
+//	Returns whether the line holds a sample
+//------------------------------------------------------------------------------
+static bool parseLine( const char* pLine, TraceSample* pSample )
+{
+    double	values	[ 3 ] = { 0.0, 0.0, 0.0 };
+    const char*	p = pLine;
+    char*	pEnd;
+    int		n;
+
+    for ( n = 0; n < 3; n++ )
+    {
+	while ( *p == ' ' || *p == '\t' || (n > 0 && *p == ',') )
+	{
+	    p++;
+	}
+	values[ n ] = strtod( p, &pEnd );
+	if ( pEnd == p )
+	{
+	    break;
+	}
+	p = pEnd;
+    }
+    if ( n < 2 )
+    {
+	return false;
+    }
+
+    pSample->timeS = values[ 0 ];
+    pSample->temperature = values[ 1 ];
+    pSample->cpuBusy = values[ 2 ];
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//  int traceNext( Trace* pTrace, TraceSample* pSample )
+//	Read the next sample of the trace.
+//	Returns 1 if a sample was read, 0 at the end of the trace, -1 if the
+//	file could not be read
+//------------------------------------------------------------------------------
+int traceNext( Trace* pTrace, TraceSample* pSample )
+{
+    if ( pTrace->bSampleLog )
+    {
+	HistoryRecord record;
+
+	if ( pTrace->nRemaining == 0 )
+	{
+	    return 0;
+	}
+	if ( fread( &record, sizeof( record ), 1, pTrace->pFile ) != 1 )
+	{
+	    fprintf( stderr, "%s: log ends early\n", pTrace->pPath );
+	    return -1;
+	}
+	pTrace->nRemaining--;
+	pSample->timeS = record.time;
+	pSample->temperature = record.temperature / 100.0;
+	pSample->cpuBusy = record.cpuLoad;
+	return 1;
+    }
+
+    while ( fgets( pTrace->line, sizeof( pTrace->line ), pTrace->pFile ) != NULL )
+    {
+	if ( pTrace->line[ 0 ] != '#' && parseLine( pTrace->line, pSample ))
+	{
+	    return 1;
+	}
+    }
+    return ferror( pTrace->pFile ) ? -1 : 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void traceClose( Trace* pTrace )
+//	Close the trace file.
+//------------------------------------------------------------------------------
+void traceClose( Trace* pTrace )
+{
+    if ( pTrace->pFile != NULL )
+    {
+	fclose( pTrace->pFile );
+	pTrace->pFile = NULL;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void simStatsInit( SimStats* pStats )
+//	Start new statistics.
+//------------------------------------------------------------------------------
+void simStatsInit( SimStats* pStats )
+{
+    memset( pStats, 0, sizeof( *pStats ));
+    pStats->band = -1;
+    pStats->fanValue = -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  void simStatsAdd( SimStats* pStats, int band, int fanValue,
+//		      double durationS )
+//	Account a sample after which range band and fan register fanValue
+//	(-1 if not written yet) were applied for durationS seconds.
+//------------------------------------------------------------------------------
+void simStatsAdd( SimStats* pStats, int band, int fanValue, double durationS )
+{
+    if ( band != pStats->band && pStats->band >= 0 )
+    {
+	pStats->transitions++;
+    }
+    if ( fanValue != pStats->fanValue && fanValue >= 0 )
+    {
+	pStats->fanWrites++;
+    }
+    pStats->band = band;
+    pStats->fanValue = fanValue;
+
+    pStats->nSamples++;
+    pStats->totalS += durationS;
+    if ( band >= 0 && band < POLICY_MAX_BANDS )
+    {
+	pStats->bandS[ band ] += durationS;
+    }
+    if ( fanValue >= 0 )
+    {
+	pStats->fanDutyS += hatFanDuty( fanValue ) * durationS;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static void printDuration( FILE* pOut, double seconds )
+//	Print seconds as h:mm:ss.
+//------------------------------------------------------------------------------
+static void printDuration( FILE* pOut, double seconds )
+{
+    long s = (long)(seconds + 0.5);
+
+    fprintf( pOut, "%4ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60 );
+}
+
+
+//------------------------------------------------------------------------------
+//  void simStatsPrint( const SimStats* pStats, const FanPolicy* pPolicy,
+//			FILE* pOut )
+//	Print the statistics, with the ranges of pPolicy.
+//------------------------------------------------------------------------------
+void simStatsPrint( const SimStats* pStats, const FanPolicy* pPolicy,
+		    FILE* pOut )
+{
+    double	hours = pStats->totalS / 3600.0;
+    int		i;
+
+    fprintf( pOut, "Samples:           %ld over ", pStats->nSamples );
+    printDuration( pOut, pStats->totalS );
+    fprintf( pOut, "\n" );
+    fprintf( pOut, "Range transitions: %lu", pStats->transitions );
+    if ( hours > 0.0 )
+    {
+	fprintf( pOut, " (%.1f per hour)", pStats->transitions / hours );
+    }
+    fprintf( pOut, "\n" );
+    fprintf( pOut, "Fan changes:       %lu\n", pStats->fanWrites );
+    fprintf( pOut, "Fan duty:          %.1f%% mean, %.2f full speed hours\n",
+	     pStats->totalS > 0.0 ? 100.0 * pStats->fanDutyS / pStats->totalS
+				  : 0.0,
+	     pStats->fanDutyS / 3600.0 );
+
+    fprintf( pOut, "\nRange  from C  fan      time     share\n" );
+    for ( i = 0; i < pPolicy->nBands; i++ )
+    {
+	fprintf( pOut, "%5d  %6.1f  0x%02x  ", i, pPolicy->bands[ i ].lower,
+		 pPolicy->bands[ i ].fanValue );
+	printDuration( pOut, pStats->bandS[ i ] );
+	fprintf( pOut, "  %5.1f%%\n",
+		 pStats->totalS > 0.0 ? 100.0 * pStats->bandS[ i ] / pStats->totalS
+				      : 0.0 );
+    }
+}
@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+//  File: 	simulate.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Input and statistics of the simulation mode of tempcontrol, which runs the
+//  controller on a recorded temperature trace as fast as possible.
+//
+//  A trace is either a sample log (samplelog.h), or a text file with one
+//  sample per line:
+//	<time s>,<temperature C>[,<CPU utilization %>]
+//  Fields may also be separated by spaces; empty lines, lines starting with
+//  '#' and lines that do not start with a number are skipped. The times
+//  must not decrease, but need not be evenly spaced: the history that the
+//  prediction uses is filled at the period of the daemon.
+//
+//  The statistics are accumulated per sample over the time to the next
+//  sample: the number of range transitions, the time spent in each range
+//  and the fan duty integrated over time.
+//
+//------------------------------------------------------------------------------
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fanpolicy.h"
+
+#define TRACE_LINE_SIZE		256
+
+typedef struct TraceSample
+{
+    double	timeS;
+    double	temperature;	// degrees Celsius
+    double	cpuBusy;	// percent, 0 if not in the trace
+} TraceSample;
+
+typedef struct Trace
+{
+    const char*	pPath;
+    FILE*	pFile;
+    bool	bSampleLog;	// binary sample log, else text
+    uint64_t	nRemaining;	// records left in a sample log
+    char	line	[ TRACE_LINE_SIZE ];
+} Trace;
+
+typedef struct SimStats
+{
+    long	nSamples;
+    double	totalS;			// simulated time
+    int		band;			// range of the previous sample
+    unsigned long transitions;		// range changes, the first not counted
+    double	bandS	[ POLICY_MAX_BANDS ];	// time in each range
+    double	fanDutyS;		// fan duty (0..1) times seconds
+    unsigned long fanWrites;		// fan register changes
+    int		fanValue;		// fan register of the previous sample
+} SimStats;
+
+int	traceOpen( Trace* pTrace, const char* pPath );
+int	traceNext( Trace* pTrace, TraceSample* pSample );
+void	traceClose( Trace* pTrace );
+
+void	simStatsInit( SimStats* pStats );
+void	simStatsAdd( SimStats* pStats, int band, int fanValue, double durationS );
+void	simStatsPrint( const SimStats* pStats, const FanPolicy* pPolicy,
+		       FILE* pOut );
+
+#endif
@@ -26,10 +26,14 @@ All text above, and the splash screen below must be included in any redistributi
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
 
 #include "ssd1306_i2c.h"
-
-#include <wiringPiI2C.h>
+#include "i2cbus.h"
 
 #include "oled_fonts.h"
 
@@ -42,11 +46,9 @@ All text above, and the splash screen below must be included in any redistributi
 void swap_values(int, int);
 
 
-int cursor_y = 0;
-int cursor_x = 0;
-
-// the memory buffer for the LCD. Displays Adafruit logo
-int buffer[SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8] = {
+// Adafruit logo for the display size selected in ssd1306_i2c.h; a new
+// context of that size starts out showing it
+static const uint8_t splash[SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8] = {
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -181,277 +183,581 @@ int buffer[SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8] = {
 #endif
 };
 
-int _vccstate;
-int i2cd;
-
 #define ssd1306_swap(a, b) { int t = a; a = b; b = t; }
 
 // the most basic function, set a single pixel
-void ssd1306_drawPixel(int x, int y, unsigned int color)
+void ssd1306_drawPixel(ssd1306_ctx *ctx, int x, int y, unsigned int color)
 {
-	if ((x < 0) || (x >= WIDTH) || (y < 0) || (y >= HEIGHT))
+	if ((x < 0) || (x >= ctx->width) || (y < 0) || (y >= ctx->height))
 		return;
 
 	// check rotation, move pixel around if necessary
 	switch (rotation) {
 	case 1:
 		ssd1306_swap(x, y);
-		x = WIDTH - x - 1;
+		x = ctx->width - x - 1;
 		break;
 	case 2:
-		x = WIDTH - x - 1;
-		y = HEIGHT - y - 1;
+		x = ctx->width - x - 1;
+		y = ctx->height - y - 1;
 		break;
 	case 3:
 		ssd1306_swap(x, y);
-		y = HEIGHT - y - 1;
+		y = ctx->height - y - 1;
 		break;
 	}
 
 	// x is which column
 	switch (color) {
 	case WHITE:
-		buffer[x + (y / 8) * SSD1306_LCDWIDTH] |= (1 << (y & 7));
+		ctx->buffer[x + (y / 8) * ctx->width] |= (1 << (y & 7));
 		break;
 	case BLACK:
-		buffer[x + (y / 8) * SSD1306_LCDWIDTH] &= ~(1 << (y & 7));
+		ctx->buffer[x + (y / 8) * ctx->width] &= ~(1 << (y & 7));
 		break;
 	case INVERSE:
-		buffer[x + (y / 8) * SSD1306_LCDWIDTH] ^= (1 << (y & 7));
+		ctx->buffer[x + (y / 8) * ctx->width] ^= (1 << (y & 7));
 		break;
 	}
 }
 
+// Set up a context for a width x height panel. This only touches memory;
+// ssd1306_begin() opens the device. Returns -1 for unsupported sizes.
+int ssd1306_init(ssd1306_ctx *ctx, int width, int height)
+{
+	if (width < 1 || width > SSD1306_MAXWIDTH ||
+	    height < 8 || height > SSD1306_MAXHEIGHT || (height & 7))
+		return -1;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->fd = -1;
+	ctx->width = width;
+	ctx->height = height;
+	ctx->textsize = 1;
+	ctx->wrap = true;
+	ctx->chunksize = SSD1306_I2C_CHUNKSIZE;
+	ctx->ramheight = height;
+
+	if (width == SSD1306_LCDWIDTH && height == SSD1306_LCDHEIGHT)
+		memcpy(ctx->buffer, splash, sizeof(splash));
+	return 0;
+}
+
+// Open the I2C adapter for the display at i2caddr, when it is not on a
+// shared bus. Returns the handle, or -1 on failure.
+static int ssd1306_open(unsigned int i2caddr)
+{
+	int fd = open(SSD1306_I2C_DEVICE, O_RDWR | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+	if (ioctl(fd, I2C_SLAVE, i2caddr) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Contrast of the panel: the value for its size and supply, or the lowest
+// one while it is dimmed.
+static unsigned int ssd1306_contrast(ssd1306_ctx *ctx)
+{
+	if (ctx->dimmed)
+		return 0;
+	if (ctx->height == 32)
+		return 0x8F;
+	if (ctx->height == 64)
+		return (ctx->vccstate == SSD1306_EXTERNALVCC) ? 0x9F : 0xCF;
+	return (ctx->vccstate == SSD1306_EXTERNALVCC) ? 0x10 : 0xAF;
+}
+
 // Init SSD1306
-void ssd1306_begin(unsigned int vccstate, unsigned int i2caddr)
+// Call once per session; ssd1306_display() does not need it again.
+// Returns 0 on success, -1 if the device could not be opened or the init
+// sequence failed.
+int ssd1306_begin(ssd1306_ctx *ctx, unsigned int vccstate, unsigned int i2caddr)
 {
 	// I2C Init
 
-	_vccstate = vccstate;
+	ctx->vccstate = vccstate;
+	ctx->i2caddr = i2caddr;
 
-	i2cd = wiringPiI2CSetup(i2caddr);
-	if (i2cd < 0) {
-		fprintf(stderr, "ssd1306_i2c : Unable to initialise I2C:\n");
-		return;
+	// Never leak the handle of a previous session
+	ssd1306_end(ctx);
+
+	// On a shared bus every transfer carries the address; no fd needed
+	if (!ctx->bus)
+		ctx->fd = ssd1306_open(i2caddr);
+	if (!ctx->bus && ctx->fd < 0) {
+		if (!ctx->quiet)
+			fprintf(stderr, "ssd1306_i2c : Unable to initialise I2C:\n");
+		ctx->i2cerror = true;
+		return -1;
 	}
+	ctx->i2cerror = false;
+
 	// Init sequence
-	ssd1306_command(SSD1306_DISPLAYOFF);	// 0xAE
-	ssd1306_command(SSD1306_SETDISPLAYCLOCKDIV);	// 0xD5
-	ssd1306_command(0x80);	// the suggested ratio 0x80
+	ssd1306_command(ctx, SSD1306_DISPLAYOFF);	// 0xAE
+	ssd1306_command(ctx, SSD1306_SETDISPLAYCLOCKDIV);	// 0xD5
+	ssd1306_command(ctx, 0x80);	// the suggested ratio 0x80
 
-	ssd1306_command(SSD1306_SETMULTIPLEX);	// 0xA8
-	ssd1306_command(SSD1306_LCDHEIGHT - 1);
+	ssd1306_command(ctx, SSD1306_SETMULTIPLEX);	// 0xA8
+	ssd1306_command(ctx, ctx->height - 1);
 
-	ssd1306_command(SSD1306_SETDISPLAYOFFSET);	// 0xD3
-	ssd1306_command(0x0);	// no offset
-	ssd1306_command(SSD1306_SETSTARTLINE | 0x0);	// line #0
-	ssd1306_command(SSD1306_CHARGEPUMP);	// 0x8D
+	ssd1306_command(ctx, SSD1306_SETDISPLAYOFFSET);	// 0xD3
+	ssd1306_command(ctx, 0x0);	// no offset
+	ssd1306_command(ctx, SSD1306_SETSTARTLINE | ctx->startline);
+	ssd1306_command(ctx, SSD1306_CHARGEPUMP);	// 0x8D
 	if (vccstate == SSD1306_EXTERNALVCC) {
-		ssd1306_command(0x10);
+		ssd1306_command(ctx, 0x10);
 	} else {
-		ssd1306_command(0x14);
-	}
-	ssd1306_command(SSD1306_MEMORYMODE);	// 0x20
-	ssd1306_command(0x00);	// 0x0 act like ks0108
-	ssd1306_command(SSD1306_SEGREMAP | 0x1);
-	ssd1306_command(SSD1306_COMSCANDEC);
-
-#if defined SSD1306_128_32
-	ssd1306_command(SSD1306_SETCOMPINS);	// 0xDA
-	ssd1306_command(0x02);
-	ssd1306_command(SSD1306_SETCONTRAST);	// 0x81
-	ssd1306_command(0x8F);
-
-#elif defined SSD1306_128_64
-	ssd1306_command(SSD1306_SETCOMPINS);	// 0xDA
-	ssd1306_command(0x12);
-	ssd1306_command(SSD1306_SETCONTRAST);	// 0x81
-	if (vccstate == SSD1306_EXTERNALVCC) {
-		ssd1306_command(0x9F);
+		ssd1306_command(ctx, 0x14);
+	}
+	ssd1306_command(ctx, SSD1306_MEMORYMODE);	// 0x20
+	ssd1306_command(ctx, 0x00);	// 0x0 act like ks0108
+	ssd1306_command(ctx, SSD1306_SEGREMAP | 0x1);
+	ssd1306_command(ctx, SSD1306_COMSCANDEC);
+
+	ssd1306_command(ctx, SSD1306_SETCOMPINS);	// 0xDA
+	if (ctx->height == 64) {
+		ssd1306_command(ctx, 0x12);
 	} else {
-		ssd1306_command(0xCF);
+		ssd1306_command(ctx, 0x02);	// ada x12
 	}
-
-#elif defined SSD1306_96_16
-	ssd1306_command(SSD1306_SETCOMPINS);	// 0xDA
-	ssd1306_command(0x2);	// ada x12
-	ssd1306_command(SSD1306_SETCONTRAST);	// 0x81
+	ssd1306_command(ctx, SSD1306_SETCONTRAST);	// 0x81
+	ssd1306_command(ctx, ssd1306_contrast(ctx));
+	ssd1306_command(ctx, SSD1306_SETPRECHARGE);	// 0xd9
 	if (vccstate == SSD1306_EXTERNALVCC) {
-		ssd1306_command(0x10);
+		ssd1306_command(ctx, 0x22);
 	} else {
-		ssd1306_command(0xAF);
+		ssd1306_command(ctx, 0xF1);
 	}
+	ssd1306_command(ctx, SSD1306_SETVCOMDETECT);	// 0xDB
+	ssd1306_command(ctx, 0x40);
+	ssd1306_command(ctx, SSD1306_DISPLAYALLON_RESUME);	// 0xA4
+	ssd1306_command(ctx, SSD1306_NORMALDISPLAY);	// 0xA6
 
-#endif
-	ssd1306_command(SSD1306_SETPRECHARGE);	// 0xd9
-	if (vccstate == SSD1306_EXTERNALVCC) {
-		ssd1306_command(0x22);
-	} else {
-		ssd1306_command(0xF1);
+	ssd1306_command(ctx, SSD1306_DEACTIVATE_SCROLL);
+
+	if (!ctx->sleeping)
+		ssd1306_command(ctx, SSD1306_DISPLAYON);	// --turn on oled panel
+
+	if (ctx->i2cerror) {
+		if (!ctx->quiet)
+			fprintf(stderr, "ssd1306_i2c : Init sequence failed\n");
+		return -1;
 	}
-	ssd1306_command(SSD1306_SETVCOMDETECT);	// 0xDB
-	ssd1306_command(0x40);
-	ssd1306_command(SSD1306_DISPLAYALLON_RESUME);	// 0xA4
-	ssd1306_command(SSD1306_NORMALDISPLAY);	// 0xA6
+	return 0;
+}
+
+// Close the I2C handle of the current session
+void ssd1306_end(ssd1306_ctx *ctx)
+{
+	if (ctx->fd >= 0) {
+		close(ctx->fd);
+		ctx->fd = -1;
+	}
+	ctx->shadowvalid = false;
+}
+
+// With enable set, ssd1306_display() reopens the device and replays the
+// init sequence when an earlier transfer failed, instead of giving up. The
+// attempts back off from SSD1306_RETRY_MS to SSD1306_RETRY_MAX_MS.
+void ssd1306_setReinitOnError(ssd1306_ctx *ctx, unsigned int enable)
+{
+	ctx->reinitonerror = enable;
+}
 
-	ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
+// Send all transfers of the display through a shared bus arbiter, at low
+// priority, instead of opening the device in ssd1306_begin(). Data
+// transfers are then limited to the transfer size of the bus.
+void ssd1306_setBus(ssd1306_ctx *ctx, struct I2cBus *bus)
+{
+	ctx->bus = bus;
+}
 
-	ssd1306_command(SSD1306_DISPLAYON);	// --turn on oled panel
+// One I2C write of len bytes to the display.
+// Returns 0 on success, -1 if the transfer failed.
+static int ssd1306_write_i2c(ssd1306_ctx *ctx, const uint8_t *buf, int len)
+{
+	if (ctx->bus)
+		return i2cBusWrite(ctx->bus, I2cPrioLow, ctx->i2caddr, buf, len);
+	return write(ctx->fd, buf, len) == len ? 0 : -1;
 }
 
-void ssd1306_invertDisplay(unsigned int i)
+void ssd1306_invertDisplay(ssd1306_ctx *ctx, unsigned int i)
 {
 	if (i) {
-		ssd1306_command(SSD1306_INVERTDISPLAY);
+		ssd1306_command(ctx, SSD1306_INVERTDISPLAY);
 	} else {
-		ssd1306_command(SSD1306_NORMALDISPLAY);
+		ssd1306_command(ctx, SSD1306_NORMALDISPLAY);
 	}
 }
 
-void ssd1306_command(unsigned int c)
+// Commands after a failed transfer are not sent: the display is not
+// responding, and ssd1306_begin() replays the settings on recovery.
+void ssd1306_command(ssd1306_ctx *ctx, unsigned int c)
 {
 	// I2C
-	unsigned int control = 0x00;	// Co = 0, D/C = 0
-	wiringPiI2CWriteReg8(i2cd, control, c);
+	uint8_t cmd[] = { 0x00, c };	// Co = 0, D/C = 0
+	if (ctx->i2cerror)
+		return;
+	if (ssd1306_write_i2c(ctx, cmd, sizeof(cmd)) < 0)
+		ctx->i2cerror = true;
 }
 
-void ssd1306_display(void)
+// Send a run of framebuffer bytes as a data stream: every write is a 0x40
+// control byte (Co = 0, D/C = 1) followed by up to chunksize data bytes.
+// Returns 0 on success, -1 if a transfer failed.
+static int ssd1306_data(ssd1306_ctx *ctx, const uint8_t *data, int size)
 {
-	ssd1306_command(SSD1306_COLUMNADDR);
-	ssd1306_command(0);	// Column start address (0 = reset)
-	ssd1306_command(SSD1306_LCDWIDTH - 1);	// Column end address (127 
-	// = reset)
+	uint8_t chunk[SSD1306_I2C_MAXCHUNK + 1];
+	int chunksize = ctx->chunksize;
+	int i, n;
+
+	// Keep the bus free for the other devices between short transfers
+	if (ctx->bus && chunksize > I2C_BUS_MAXWRITE - 1)
+		chunksize = I2C_BUS_MAXWRITE - 1;
+
+	chunk[0] = 0x40;
+	for (i = 0; i < size; i += n) {
+		n = size - i;
+		if (n > chunksize)
+			n = chunksize;
+		memcpy(chunk + 1, data + i, n);
+		if (ssd1306_write_i2c(ctx, chunk, n + 1) < 0) {
+			fprintf(stderr, "ssd1306_i2c : Data transfer failed\n");
+			ctx->i2cerror = true;
+			return -1;
+		}
+	}
+	return 0;
+}
 
-	ssd1306_command(SSD1306_PAGEADDR);
-	ssd1306_command(0);	// Page start address (0 = reset)
-#if SSD1306_LCDHEIGHT == 64
-	ssd1306_command(7);	// Page end address
-#endif
-#if SSD1306_LCDHEIGHT == 32
-	ssd1306_command(3);	// Page end address
-#endif
-#if SSD1306_LCDHEIGHT == 16
-	ssd1306_command(1);	// Page end address
-#endif
+// Point the display RAM window at columns x0..x1 of pages p0..p1. The six
+// command bytes go out as one command stream (control byte 0x00).
+static int ssd1306_window(ssd1306_ctx *ctx, int x0, int x1, int p0, int p1)
+{
+	uint8_t cmd[] = { 0x00,
+		SSD1306_COLUMNADDR, x0, x1,
+		SSD1306_PAGEADDR, p0, p1
+	};
+
+	if (ssd1306_write_i2c(ctx, cmd, sizeof(cmd)) < 0) {
+		fprintf(stderr, "ssd1306_i2c : Command transfer failed\n");
+		ctx->i2cerror = true;
+		return -1;
+	}
+	return 0;
+}
 
-	// I2C
-	int i;
-	for (i = 0; i < (SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8); i++) {
-		wiringPiI2CWriteReg8(i2cd, 0x40, buffer[i]); 
-		//This sends byte by byte. 
-		//Better to send all buffer without 0x40 first
-		//Should be optimized
+// Monotonic time in milliseconds
+static long long ssd1306_nowms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Replay the init sequence after an I2C error, when it is due. Only the
+// first failure and the recovery are reported.
+// Returns 0 if the session was recovered, -1 otherwise.
+static int ssd1306_recover(ssd1306_ctx *ctx)
+{
+	long long now = ssd1306_nowms();
+	int result;
+
+	if (ctx->retryms > 0 && now < ctx->retryat)
+		return -1;
+
+	ctx->quiet = true;
+	result = ssd1306_begin(ctx, ctx->vccstate, ctx->i2caddr);
+	ctx->quiet = false;
+	if (result < 0) {
+		if (ctx->retryms == 0) {
+			fprintf(stderr, "ssd1306_i2c : Display not responding, "
+				"retrying\n");
+			ctx->retryms = SSD1306_RETRY_MS;
+		} else if (ctx->retryms < SSD1306_RETRY_MAX_MS) {
+			ctx->retryms *= 2;
+		}
+		ctx->retryat = now + ctx->retryms;
+		return -1;
 	}
+	if (ctx->retryms > 0)
+		fprintf(stderr, "ssd1306_i2c : Display recovered\n");
+	ctx->retryms = 0;
+	return 0;
+}
+
+// Columns *first..*last of a page of the framebuffer that differ from what
+// was sent last time.
+// Returns whether the page changed.
+static int ssd1306_span(ssd1306_ctx *ctx, int page, int *first, int *last)
+{
+	uint8_t *row = ctx->buffer + page * ctx->width;
+	uint8_t *sent = ctx->shadow + page * ctx->width;
+	int x0 = 0;
+	int x1 = ctx->width - 1;
+
+	while (x0 <= x1 && row[x0] == sent[x0])
+		x0++;
+	if (x0 > x1)
+		return false;
+	while (row[x1] == sent[x1])
+		x1--;
+	*first = x0;
+	*last = x1;
+	return true;
+}
+
+// Send columns x0..x1 of pages p0..p1 of the framebuffer through one
+// window; the display RAM takes them row by row in horizontal addressing
+// mode.
+// Returns 0 on success, -1 if a transfer failed.
+static int ssd1306_rect(ssd1306_ctx *ctx, int x0, int x1, int p0, int p1)
+{
+	uint8_t data[SSD1306_MAXWIDTH * SSD1306_MAXHEIGHT / 8];
+	int w = x1 - x0 + 1;
+	int n = 0;
+	int p;
+
+	for (p = p0; p <= p1; p++) {
+		memcpy(data + n, ctx->buffer + p * ctx->width + x0, w);
+		n += w;
+	}
+	if (ssd1306_window(ctx, x0, x1, p0, p1) < 0 ||
+	    ssd1306_data(ctx, data, n) < 0)
+		return -1;
+	for (p = p0; p <= p1; p++)
+		memcpy(ctx->shadow + p * ctx->width + x0,
+		       ctx->buffer + p * ctx->width + x0, w);
+	return 0;
+}
+
+// Transfer the framebuffer to the display. Only the column span of each
+// page that differs from what was sent last time goes over the bus; an
+// unchanged framebuffer produces no I2C traffic at all. The spans of
+// adjacent pages share one window when the columns added to fill it cost
+// less than the bytes of another window, e.g. a column that changed in
+// all pages of a graph.
+// Returns 0 on success, -1 if the display could not be updated.
+int ssd1306_display(ssd1306_ctx *ctx)
+{
+	int pages = ctx->ramheight / 8;
+	int page = 0;
+
+	if (ctx->i2cerror) {
+		// Health check: recover the session only when asked to
+		if (!ctx->reinitonerror || ssd1306_recover(ctx) < 0)
+			return -1;
+	}
+
+	if (!ctx->shadowvalid) {
+		// Display RAM contents are unknown: send everything in one go
+		if (ssd1306_window(ctx, 0, ctx->width - 1, 0, pages - 1) < 0 ||
+		    ssd1306_data(ctx, ctx->buffer, ctx->width * pages) < 0)
+			return -1;
+		memcpy(ctx->shadow, ctx->buffer, ctx->width * pages);
+		ctx->shadowvalid = true;
+		return 0;
+	}
+
+	while (page < pages) {
+		int x0, x1, p1, first, last;
+
+		if (!ssd1306_span(ctx, page, &x0, &x1)) {
+			page++;	// page unchanged
+			continue;
+		}
+
+		for (p1 = page; p1 + 1 < pages &&
+		     ssd1306_span(ctx, p1 + 1, &first, &last); p1++) {
+			int u0 = first < x0 ? first : x0;
+			int u1 = last > x1 ? last : x1;
+			int merged = (u1 - u0 + 1) * (p1 - page + 2);
+			int apart = (x1 - x0 + 1) * (p1 - page + 1) +
+			    (last - first + 1) + SSD1306_WINDOW_BYTES;
+
+			if (merged > apart)
+				break;
+			x0 = u0;
+			x1 = u1;
+		}
+
+		if (ssd1306_rect(ctx, x0, x1, page, p1) < 0) {
+			// Panel state is uncertain now; resend it all next time
+			ctx->shadowvalid = false;
+			return -1;
+		}
+		page = p1 + 1;
+	}
+	return 0;
+}
+
+// Forget what was sent to the display, so that the next ssd1306_display()
+// transfers the complete framebuffer.
+void ssd1306_invalidate(ssd1306_ctx *ctx)
+{
+	ctx->shadowvalid = false;
+}
+
+// Set the number of data bytes sent per I2C write in ssd1306_display().
+// The control byte comes on top, so the bus adapter must accept size + 1
+// bytes in one transfer. Values are clamped to 1..SSD1306_I2C_MAXCHUNK.
+void ssd1306_setChunkSize(ssd1306_ctx *ctx, int size)
+{
+	if (size < 1)
+		size = 1;
+	if (size > SSD1306_I2C_MAXCHUNK)
+		size = SSD1306_I2C_MAXCHUNK;
+	ctx->chunksize = size;
 }
 
 // startscrollright
 // Activate a right handed scroll for rows start through stop
 // Hint, the display is 16 rows tall. To scroll the whole display, run:
 // ssd1306_scrollright(0x00, 0x0F)
-void ssd1306_startscrollright(unsigned int start, unsigned int stop)
+void ssd1306_startscrollright(ssd1306_ctx *ctx, unsigned int start,
+			      unsigned int stop)
 {
-	ssd1306_command(SSD1306_RIGHT_HORIZONTAL_SCROLL);
-	ssd1306_command(0X00);
-	ssd1306_command(start);
-	ssd1306_command(0X00);
-	ssd1306_command(stop);
-	ssd1306_command(0X00);
-	ssd1306_command(0XFF);
-	ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+	ssd1306_command(ctx, SSD1306_RIGHT_HORIZONTAL_SCROLL);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, start);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, stop);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, 0XFF);
+	ssd1306_command(ctx, SSD1306_ACTIVATE_SCROLL);
 }
 
 // startscrollleft
 // Activate a right handed scroll for rows start through stop
 // Hint, the display is 16 rows tall. To scroll the whole display, run:
 // ssd1306_scrollright(0x00, 0x0F)
-void ssd1306_startscrollleft(unsigned int start, unsigned int stop)
+void ssd1306_startscrollleft(ssd1306_ctx *ctx, unsigned int start,
+			     unsigned int stop)
 {
-	ssd1306_command(SSD1306_LEFT_HORIZONTAL_SCROLL);
-	ssd1306_command(0X00);
-	ssd1306_command(start);
-	ssd1306_command(0X00);
-	ssd1306_command(stop);
-	ssd1306_command(0X00);
-	ssd1306_command(0XFF);
-	ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+	ssd1306_command(ctx, SSD1306_LEFT_HORIZONTAL_SCROLL);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, start);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, stop);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, 0XFF);
+	ssd1306_command(ctx, SSD1306_ACTIVATE_SCROLL);
 }
 
 // startscrolldiagright
 // Activate a diagonal scroll for rows start through stop
 // Hint, the display is 16 rows tall. To scroll the whole display, run:
 // ssd1306_scrollright(0x00, 0x0F)
-void ssd1306_startscrolldiagright(unsigned int start, unsigned int stop)
+void ssd1306_startscrolldiagright(ssd1306_ctx *ctx, unsigned int start,
+				  unsigned int stop)
 {
-	ssd1306_command(SSD1306_SET_VERTICAL_SCROLL_AREA);
-	ssd1306_command(0X00);
-	ssd1306_command(SSD1306_LCDHEIGHT);
-	ssd1306_command(SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL);
-	ssd1306_command(0X00);
-	ssd1306_command(start);
-	ssd1306_command(0X00);
-	ssd1306_command(stop);
-	ssd1306_command(0X01);
-	ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+	ssd1306_command(ctx, SSD1306_SET_VERTICAL_SCROLL_AREA);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, ctx->height);
+	ssd1306_command(ctx, SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, start);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, stop);
+	ssd1306_command(ctx, 0X01);
+	ssd1306_command(ctx, SSD1306_ACTIVATE_SCROLL);
 }
 
 // startscrolldiagleft
 // Activate a diagonal scroll for rows start through stop
 // Hint, the display is 16 rows tall. To scroll the whole display, run:
 // ssd1306_scrollright(0x00, 0x0F)
-void ssd1306_startscrolldiagleft(unsigned int start, unsigned int stop)
+void ssd1306_startscrolldiagleft(ssd1306_ctx *ctx, unsigned int start,
+				 unsigned int stop)
 {
-	ssd1306_command(SSD1306_SET_VERTICAL_SCROLL_AREA);
-	ssd1306_command(0X00);
-	ssd1306_command(SSD1306_LCDHEIGHT);
-	ssd1306_command(SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL);
-	ssd1306_command(0X00);
-	ssd1306_command(start);
-	ssd1306_command(0X00);
-	ssd1306_command(stop);
-	ssd1306_command(0X01);
-	ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+	ssd1306_command(ctx, SSD1306_SET_VERTICAL_SCROLL_AREA);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, ctx->height);
+	ssd1306_command(ctx, SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, start);
+	ssd1306_command(ctx, 0X00);
+	ssd1306_command(ctx, stop);
+	ssd1306_command(ctx, 0X01);
+	ssd1306_command(ctx, SSD1306_ACTIVATE_SCROLL);
 }
 
-void ssd1306_stopscroll(void)
+void ssd1306_stopscroll(ssd1306_ctx *ctx)
 {
-	ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
+	ssd1306_command(ctx, SSD1306_DEACTIVATE_SCROLL);
 }
 
 // Dim the display
 // dim = true: display is dimmed
-// dim = false: display is normal
-void ssd1306_dim(unsigned int dim)
+// dim = false: display is normal, at the contrast of ssd1306_begin()
+// The setting is kept when ssd1306_begin() recovers the display.
+void ssd1306_dim(ssd1306_ctx *ctx, unsigned int dim)
 {
-	unsigned int contrast;
-
-	if (dim) {
-		contrast = 0;	// Dimmed display
-	} else {
-		if (_vccstate == SSD1306_EXTERNALVCC) {
-			contrast = 0x9F;
-		} else {
-			contrast = 0xCF;
-		}
-	}
+	ctx->dimmed = dim ? true : false;
 	// the range of contrast to too small to be really useful
 	// it is useful to dim the display
-	ssd1306_command(SSD1306_SETCONTRAST);
-	ssd1306_command(contrast);
+	ssd1306_command(ctx, SSD1306_SETCONTRAST);
+	ssd1306_command(ctx, ssd1306_contrast(ctx));
+}
+
+// Switch the panel off (sleep = true) or on again. The display RAM keeps
+// its contents while the panel is off, so ssd1306_display() need not send
+// anything on wake up. The setting is kept when ssd1306_begin() recovers
+// the display.
+void ssd1306_sleep(ssd1306_ctx *ctx, unsigned int sleep)
+{
+	ctx->sleeping = sleep ? true : false;
+	ssd1306_command(ctx, sleep ? SSD1306_DISPLAYOFF : SSD1306_DISPLAYON);
+}
+
+// Let the framebuffer mirror rows display RAM rows instead of only the
+// height of the panel; the SSD1306 has 64 rows, so a 128x32 panel has room
+// for a second page below the visible one. Drawing functions still clip to
+// the panel; the caller fills the rows below it in buffer directly, and
+// ssd1306_setStartLine() selects what is shown.
+// Returns 0 on success, -1 if rows is not a multiple of 8 from height up to
+// SSD1306_MAXHEIGHT.
+int ssd1306_setRamHeight(ssd1306_ctx *ctx, int rows)
+{
+	if (rows < ctx->height || rows > SSD1306_MAXHEIGHT || (rows & 7))
+		return -1;
+	if (rows != ctx->ramheight) {
+		ctx->ramheight = rows;
+		ctx->shadowvalid = false;
+	}
+	return 0;
+}
+
+// Show display RAM from row line on the top of the panel, wrapping around
+// at the end of display RAM. Changing the start line moves the picture
+// without any data transfer. Nothing is sent if line is already shown.
+void ssd1306_setStartLine(ssd1306_ctx *ctx, int line)
+{
+	line &= SSD1306_MAXHEIGHT - 1;
+	if (line == ctx->startline)
+		return;
+	ctx->startline = line;
+	ssd1306_command(ctx, SSD1306_SETSTARTLINE | line);
 }
 
 // clear everything
-void ssd1306_clearDisplay(void)
+void ssd1306_clearDisplay(ssd1306_ctx *ctx)
 {
-	memset(buffer, 0,
-	       (SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8) * sizeof(int));
-	cursor_y = 0;
-	cursor_x = 0;
+	memset(ctx->buffer, 0, ctx->width * ctx->height / 8);
+	ctx->cursor_y = 0;
+	ctx->cursor_x = 0;
 }
 
-void ssd1306_drawFastHLineInternal(int x, int y, int w, unsigned int color)
+void ssd1306_drawFastHLineInternal(ssd1306_ctx *ctx, int x, int y, int w,
+				   unsigned int color)
 {
 	// Do bounds/limit checks
-	if (y < 0 || y >= HEIGHT) {
+	if (y < 0 || y >= ctx->height) {
 		return;
 	}
 	// make sure we don't try to draw below 0
@@ -460,17 +766,17 @@ void ssd1306_drawFastHLineInternal(int x, int y, int w, unsigned int color)
 		x = 0;
 	}
 	// make sure we don't go off the edge of the display
-	if ((x + w) > WIDTH) {
-		w = (WIDTH - x);
+	if ((x + w) > ctx->width) {
+		w = (ctx->width - x);
 	}
 	// if our width is now negative, punt
 	if (w <= 0) {
 		return;
 	}
 	// set up the pointer for movement through the buffer
-	unsigned int *pBuf = buffer;
+	uint8_t *pBuf = ctx->buffer;
 	// adjust the buffer pointer for the current row
-	pBuf += ((y / 8) * SSD1306_LCDWIDTH);
+	pBuf += ((y / 8) * ctx->width);
 	// and offset x columns in
 	pBuf += x;
 
@@ -496,11 +802,12 @@ void ssd1306_drawFastHLineInternal(int x, int y, int w, unsigned int color)
 	}
 }
 
-void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
+void ssd1306_drawFastVLineInternal(ssd1306_ctx *ctx, int x, int __y, int __h,
+				   unsigned int color)
 {
 
 	// do nothing if we're off the left or right side of the screen
-	if (x < 0 || x >= WIDTH) {
+	if (x < 0 || x >= ctx->width) {
 		return;
 	}
 	// make sure we don't try to draw below 0
@@ -512,8 +819,8 @@ void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
 
 	}
 	// make sure we don't go past the height of the display
-	if ((__y + __h) > HEIGHT) {
-		__h = (HEIGHT - __y);
+	if ((__y + __h) > ctx->height) {
+		__h = (ctx->height - __y);
 	}
 	// if our height is now negative, punt
 	if (__h <= 0) {
@@ -525,9 +832,9 @@ void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
 	unsigned int h = __h;
 
 	// set up the pointer for fast movement through the buffer
-	unsigned int *pBuf = buffer;
+	uint8_t *pBuf = ctx->buffer;
 	// adjust the buffer pointer for the current row
-	pBuf += ((y / 8) * SSD1306_LCDWIDTH);
+	pBuf += ((y / 8) * ctx->width);
 	// and offset x columns in
 	pBuf += x;
 
@@ -570,7 +877,7 @@ void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
 
 		h -= mod;
 
-		pBuf += SSD1306_LCDWIDTH;
+		pBuf += ctx->width;
 	}
 	// write solid bytes while we can - effectively doing 8 rows at a time
 	if (h >= 8) {
@@ -582,7 +889,7 @@ void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
 				*pBuf = ~(*pBuf);
 
 				// adjust the buffer forward 8 rows worth of data
-				pBuf += SSD1306_LCDWIDTH;
+				pBuf += ctx->width;
 
 				// adjust h & y (there's got to be a faster way for me to
 				// do this, but this should still help a fair bit for now)
@@ -598,7 +905,7 @@ void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
 				*pBuf = val;
 
 				// adjust the buffer forward 8 rows worth of data
-				pBuf += SSD1306_LCDWIDTH;
+				pBuf += ctx->width;
 
 				// adjust h & y (there's got to be a faster way for me to
 				// do this, but this should still help a fair bit for now)
@@ -632,7 +939,8 @@ void ssd1306_drawFastVLineInternal(int x, int __y, int __h, unsigned int color)
 	}
 }
 
-void ssd1306_drawFastHLine(int x, int y, int w, unsigned int color)
+void ssd1306_drawFastHLine(ssd1306_ctx *ctx, int x, int y, int w,
+			   unsigned int color)
 {
 	unsigned int bSwap = false;
 	switch (rotation) {
@@ -643,13 +951,13 @@ void ssd1306_drawFastHLine(int x, int y, int w, unsigned int color)
 		// 90 degree rotation, swap x & y for rotation, then invert x
 		bSwap = true;
 		ssd1306_swap(x, y);
-		x = WIDTH - x - 1;
+		x = ctx->width - x - 1;
 		break;
 	case 2:
 		// 180 degree rotation, invert x and y - then shift y around for
 		// height.
-		x = WIDTH - x - 1;
-		y = HEIGHT - y - 1;
+		x = ctx->width - x - 1;
+		y = ctx->height - y - 1;
 		x -= (w - 1);
 		break;
 	case 3:
@@ -657,19 +965,20 @@ void ssd1306_drawFastHLine(int x, int y, int w, unsigned int color)
 		// adjust y for w (not to become h)
 		bSwap = true;
 		ssd1306_swap(x, y);
-		y = HEIGHT - y - 1;
+		y = ctx->height - y - 1;
 		y -= (w - 1);
 		break;
 	}
 
 	if (bSwap) {
-		ssd1306_drawFastVLineInternal(x, y, w, color);
+		ssd1306_drawFastVLineInternal(ctx, x, y, w, color);
 	} else {
-		ssd1306_drawFastHLineInternal(x, y, w, color);
+		ssd1306_drawFastHLineInternal(ctx, x, y, w, color);
 	}
 }
 
-void ssd1306_drawFastVLine(int x, int y, int h, unsigned int color)
+void ssd1306_drawFastVLine(ssd1306_ctx *ctx, int x, int y, int h,
+			   unsigned int color)
 {
 	unsigned int bSwap = false;
 	switch (rotation) {
@@ -680,101 +989,100 @@ void ssd1306_drawFastVLine(int x, int y, int h, unsigned int color)
 		// adjust x for h (now to become w)
 		bSwap = true;
 		ssd1306_swap(x, y);
-		x = WIDTH - x - 1;
+		x = ctx->width - x - 1;
 		x -= (h - 1);
 		break;
 	case 2:
 		// 180 degree rotation, invert x and y - then shift y around for
 		// height.
-		x = WIDTH - x - 1;
-		y = HEIGHT - y - 1;
+		x = ctx->width - x - 1;
+		y = ctx->height - y - 1;
 		y -= (h - 1);
 		break;
 	case 3:
 		// 270 degree rotation, swap x & y for rotation, then invert y
 		bSwap = true;
 		ssd1306_swap(x, y);
-		y = HEIGHT - y - 1;
+		y = ctx->height - y - 1;
 		break;
 	}
 
 	if (bSwap) {
-		ssd1306_drawFastHLineInternal(x, y, h, color);
+		ssd1306_drawFastHLineInternal(ctx, x, y, h, color);
 	} else {
-		ssd1306_drawFastVLineInternal(x, y, h, color);
+		ssd1306_drawFastVLineInternal(ctx, x, y, h, color);
 	}
 }
 
-void ssd1306_fillRect(int x, int y, int w, int h, int fillcolor)
+void ssd1306_fillRect(ssd1306_ctx *ctx, int x, int y, int w, int h,
+		      int fillcolor)
 {
 
 	// Bounds check
-	if ((x >= WIDTH) || (y >= HEIGHT))
+	if ((x >= ctx->width) || (y >= ctx->height))
 		return;
 
 	// Y bounds check
-	if (y + h > HEIGHT) {
-		h = HEIGHT - y - 1;
+	if (y + h > ctx->height) {
+		h = ctx->height - y - 1;
 	}
 	// X bounds check
-	if (x + w > WIDTH) {
-		w = WIDTH - x - 1;
+	if (x + w > ctx->width) {
+		w = ctx->width - x - 1;
 	}
 
 	switch (rotation) {
 	case 1:
 		swap_values(x, y);
-		x = WIDTH - x - 1;
+		x = ctx->width - x - 1;
 		break;
 	case 2:
-		x = WIDTH - x - 1;
-		y = HEIGHT - y - 1;
+		x = ctx->width - x - 1;
+		y = ctx->height - y - 1;
 		break;
 	case 3:
 		swap_values(x, y);
-		y = HEIGHT - y - 1;
+		y = ctx->height - y - 1;
 		break;
 	}
 	int i;
 	for (i = 0; i < h; i++)
-		ssd1306_drawFastHLine(x, y + i, w, fillcolor);
+		ssd1306_drawFastHLine(ctx, x, y + i, w, fillcolor);
 }
 
-int textsize = 1;
-int wrap = 1;
-
-void ssd1306_setTextSize(int s)
+void ssd1306_setTextSize(ssd1306_ctx *ctx, int s)
 {
-	textsize = (s > 0) ? s : 1;
+	ctx->textsize = (s > 0) ? s : 1;
 }
 
-void ssd1306_write(int c)
+void ssd1306_write(ssd1306_ctx *ctx, int c)
 {
 
 	if (c == '\n') {
-		cursor_y += textsize * 8;
-		cursor_x = 0;
+		ctx->cursor_y += ctx->textsize * 8;
+		ctx->cursor_x = 0;
 	} else if (c == '\r') {
 		// skip em
 	} else {
-		ssd1306_drawChar(cursor_x, cursor_y, c, WHITE, textsize);
-		cursor_x += textsize * 6;
-		if (wrap && (cursor_x > (WIDTH - textsize * 6))) {
-			cursor_y += textsize * 8;
-			cursor_x = 0;
+		ssd1306_drawChar(ctx, ctx->cursor_x, ctx->cursor_y, c, WHITE,
+				 ctx->textsize);
+		ctx->cursor_x += ctx->textsize * 6;
+		if (ctx->wrap && (ctx->cursor_x > (ctx->width - ctx->textsize * 6))) {
+			ctx->cursor_y += ctx->textsize * 8;
+			ctx->cursor_x = 0;
 		}
 	}
 }
 
-void ssd1306_drawString(char *str)
+void ssd1306_drawString(ssd1306_ctx *ctx, char *str)
 {
 	int i, end;
 	end = strlen(str);
 	for (i = 0; i < end; i++)
-		ssd1306_write(str[i]);
+		ssd1306_write(ctx, str[i]);
 }
 
-void ssd1306_drawText(int x, int y, char *str)
+void ssd1306_drawText(ssd1306_ctx *ctx, int x, int y, char *str)
 {
 	int i, end;
 	end = strlen(str);
@@ -784,7 +1092,7 @@ void ssd1306_drawText(int x, int y, char *str)
 	{
 		if (str[i] == '\n')
 		{
-			point_y += textsize * 8;
+			point_y += ctx->textsize * 8;
 			point_x = 0;
 		}
 		else if (str[i] == '\r')
@@ -793,26 +1101,117 @@ void ssd1306_drawText(int x, int y, char *str)
 		}
 		else
 		{
-			ssd1306_drawChar(point_x, point_y, str[i], WHITE, textsize);
-			point_x += textsize * 6;
-			if (wrap && (point_x > (WIDTH - textsize * 6)))
+			ssd1306_drawChar(ctx, point_x, point_y, str[i], WHITE,
+					 ctx->textsize);
+			point_x += ctx->textsize * 6;
+			if (ctx->wrap && (point_x > (ctx->width - ctx->textsize * 6)))
 			{
-				point_y += textsize * 8;
+				point_y += ctx->textsize * 8;
 				point_x = 0;
 			}
 		}
 	}
 }
 
+// Blit an unscaled white character. A font column has the same layout as
+// a display page byte (LSB on top), so a glyph is 5 byte ORs into one page
+// when y is a multiple of 8, or two shifted ORs per column when it is not.
+// The sixth column of a character cell is blank and needs no write.
+// The caller has clipped the character cell to the display.
+static void ssd1306_blitChar(ssd1306_ctx *ctx, int x, int y, unsigned char c)
+{
+	const unsigned char *glyph = font + (c * 5);
+	int pages = ctx->height / 8;
+	int page = (y + 8) / 8 - 1;	// rounds down for -8 < y < 0 too
+	int shift = y - page * 8;
+	int upper = page * ctx->width;	// offset of the page holding row y
+	int lower = upper + ctx->width;
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		int col = x + i;
+		if (col < 0 || col >= ctx->width)
+			continue;
+		unsigned int line = pgm_read_byte(glyph + i);
+		if (page >= 0)
+			ctx->buffer[upper + col] |= line << shift;
+		if (shift && page + 1 < pages)
+			ctx->buffer[lower + col] |= line >> (8 - shift);
+	}
+}
+
+#if defined SSD1306_FONT_X2 || defined SSD1306_FONT_X3
+// Glyph column byte line scaled vertically by size, from the pre-scaled
+// tables in oled_fonts.h
+static unsigned long ssd1306_scaledColumn(unsigned int line, int size)
+{
+#if defined SSD1306_FONT_X2
+	if (size == 2)
+		return font_x2[line];
+#endif
+#if defined SSD1306_FONT_X3
+	if (size == 3)
+		return font_x3[line];
+#endif
+	return 0;
+}
+
+// Blit a white character scaled by a size that has a pre-scaled table.
+// Each font column becomes 8 * size bits tall; it is shifted to y and
+// ORed into the size + 1 pages it covers, repeated for size columns.
+// The caller has clipped the character cell to the display.
+static void ssd1306_blitScaled(ssd1306_ctx *ctx, int x, int y,
+			       unsigned char c, int size)
+{
+	const unsigned char *glyph = font + (c * 5);
+	int pages = ctx->height / 8;
+	int page = (y >= 0) ? y / 8 : -((7 - y) / 8);	// rounds down
+	int shift = y - page * 8;
+	int i, k, r;
+
+	for (i = 0; i < 5; i++) {
+		unsigned long bits =
+		    ssd1306_scaledColumn(pgm_read_byte(glyph + i), size);
+		if (!bits)
+			continue;
+		bits <<= shift;
+		for (k = 0; k <= size; k++) {
+			int p = page + k;
+			uint8_t val = bits >> (8 * k);
+			if (!val || p < 0 || p >= pages)
+				continue;
+			for (r = 0; r < size; r++) {
+				int col = x + i * size + r;
+				if (col >= 0 && col < ctx->width)
+					ctx->buffer[p * ctx->width + col] |= val;
+			}
+		}
+	}
+}
+#endif
+
 // Draw a character
-void ssd1306_drawChar(int x, int y, unsigned char c, int color, int size)
+void ssd1306_drawChar(ssd1306_ctx *ctx, int x, int y, unsigned char c,
+		      int color, int size)
 {
 
-	if ((x >= WIDTH) ||	// Clip right
-	    (y >= HEIGHT) ||	// Clip bottom
+	if ((x >= ctx->width) ||	// Clip right
+	    (y >= ctx->height) ||	// Clip bottom
 	    ((x + 6 * size - 1) < 0) ||	// Clip left
 	    ((y + 8 * size - 1) < 0))	// Clip top
 		return;
+	if (color == WHITE && rotation == 0) {
+		if (size == 1) {
+			ssd1306_blitChar(ctx, x, y, c);
+			return;
+		}
+#if defined SSD1306_FONT_X2 || defined SSD1306_FONT_X3
+		if (ssd1306_scaledColumn(0xFF, size)) {
+			ssd1306_blitScaled(ctx, x, y, c, size);
+			return;
+		}
+#endif
+	}
 	int i;
 	int j;
 	for (i = 0; i < 6; i++) {
@@ -824,9 +1223,9 @@ void ssd1306_drawChar(int x, int y, unsigned char c, int color, int size)
 		for (j = 0; j < 8; j++) {
 			if (line & 0x1) {
 				if (size == 1)	// default size
-					ssd1306_drawPixel(x + i, y + j, color);
+					ssd1306_drawPixel(ctx, x + i, y + j, color);
 				else {	// big size
-					ssd1306_fillRect(x + (i * size),
+					ssd1306_fillRect(ctx, x + (i * size),
 							 y + (j * size), size,
 							 size, color);
 				}
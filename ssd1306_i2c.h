@@ -26,11 +26,14 @@ All text above, and the splash screen must be included in any redistribution
 #ifndef SSD1306_I2C_H_
 #define SSD1306_I2C_H_
 
+#include <stdint.h>
+
 #define BLACK 0
 #define WHITE 1
 #define INVERSE 2
 
 #define SSD1306_I2C_ADDRESS   0x3C	// 011110+SA0+RW - 0x3C or 0x3D
+#define SSD1306_I2C_DEVICE    "/dev/i2c-1"	// adapter without a shared bus
 // Address for 128x32 is 0x3C
 // Address for 128x64 is 0x3D (default) or 0x3C (if SA0 is grounded)
 
@@ -38,8 +41,9 @@ All text above, and the splash screen must be included in any redistribution
     SSD1306 Displays
     -----------------------------------------------------------------------
     The driver is used in multiple displays (128x64, 128x32, etc.).
-    Select the appropriate display below to create an appropriately
-    sized framebuffer, etc.
+    Select the appropriate display below to set the default size passed
+    to ssd1306_init(). Other sizes up to SSD1306_MAXWIDTH x
+    SSD1306_MAXHEIGHT can be driven at runtime from the same binary.
 
     SSD1306_128_64  128x64 pixel display
 
@@ -88,6 +92,36 @@ All text above, and the splash screen must be included in any redistribution
         #define SSD1306_LCDHEIGHT                 16
 #endif
 
+// Text sizes drawn from pre-scaled font tables (see oled_fonts.h). Only
+// the tables enabled here, or with -DSSD1306_FONT_X3, are compiled in;
+// other sizes above 1 are drawn pixel by pixel. tempcontrol draws the
+// temperature in size 2.
+#ifndef SSD1306_FONT_X2
+#define SSD1306_FONT_X2
+#endif
+// #define SSD1306_FONT_X3
+
+// Bulk transfer: number of data bytes per I2C write in ssd1306_display().
+// Each write carries one extra control byte, so keep this within the limit
+// of the bus adapter. It can be changed at runtime with ssd1306_setChunkSize.
+#ifndef SSD1306_I2C_CHUNKSIZE
+#define SSD1306_I2C_CHUNKSIZE 32
+#endif
+#define SSD1306_I2C_MAXCHUNK (SSD1306_MAXWIDTH * SSD1306_MAXHEIGHT / 8)
+// Bytes of setting a window: control byte, column and page address
+// commands, and the control byte of its data
+#define SSD1306_WINDOW_BYTES 8
+
+// Recovery after I2C errors (ssd1306_setReinitOnError): the first attempt
+// is made right away, then the delay between attempts doubles up to the
+// maximum, so a missing display costs one failed transfer per minute.
+#define SSD1306_RETRY_MS 1000
+#define SSD1306_RETRY_MAX_MS 64000
+
+// Largest panel a context can hold
+#define SSD1306_MAXWIDTH 128
+#define SSD1306_MAXHEIGHT 64
+
 #define SSD1306_SETCONTRAST 0x81
 #define SSD1306_DISPLAYALLON_RESUME 0xA4
 #define SSD1306_DISPLAYALLON 0xA5
@@ -134,32 +168,74 @@ All text above, and the splash screen must be included in any redistribution
 #define SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL 0x29
 #define SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL 0x2A
 
-void ssd1306_begin(unsigned int switchvcc, unsigned int i2caddr); //switchvcc should be SSD1306_SWITCHCAPVCC
-void ssd1306_command(unsigned int c);
-
-void ssd1306_clearDisplay(void);
-void ssd1306_invertDisplay(unsigned int i);
-void ssd1306_display();
-
-void ssd1306_startscrollright(unsigned int start, unsigned int stop);
-void ssd1306_startscrollleft(unsigned int start, unsigned int stop);
-
-void ssd1306_startscrolldiagright(unsigned int start, unsigned int stop);
-void ssd1306_startscrolldiagleft(unsigned int start, unsigned int stop);
-void ssd1306_stopscroll(void);
-
-void ssd1306_dim(unsigned int dim);
-
-void ssd1306_drawPixel(int x, int y, unsigned int color);
-
-void ssd1306_drawFastVLine(int x, int y, int h, unsigned int color);
-void ssd1306_drawFastHLine(int x, int y, int w, unsigned int color);
-
-void ssd1306_fillRect(int x, int y, int w, int h, int fillcolor);
-
-void ssd1306_setTextSize(int s);
-void ssd1306_drawString(char *str);
-void ssd1306_drawText(int x, int y, char *str);
-void ssd1306_drawChar(int x, int y, unsigned char c, int color, int size);
+// Per-display state. The caller owns it; every function below takes the
+// context of the display it draws on, so several panels can be driven
+// from one process.
+struct I2cBus;
+
+typedef struct ssd1306_ctx {
+	int fd;			// I2C handle, -1 when closed
+	struct I2cBus *bus;	// shared bus used instead of fd, or NULL
+	unsigned int i2caddr;
+	unsigned int vccstate;
+	int width;
+	int height;
+	int cursor_x;
+	int cursor_y;
+	int textsize;
+	int wrap;
+	int chunksize;		// data bytes per I2C write
+	int i2cerror;		// a transfer failed since the last begin
+	int reinitonerror;
+	int retryms;		// delay of the next recovery, 0 if not failed
+	long long retryat;	// monotonic ms of the next recovery attempt
+	int quiet;		// no messages from ssd1306_begin()
+	int shadowvalid;
+	int ramheight;		// rows of display RAM in buffer, >= height
+	int startline;		// display RAM row shown on top
+	int dimmed;		// contrast lowered by ssd1306_dim()
+	int sleeping;		// panel switched off by ssd1306_sleep()
+	// framebuffer, 8 vertical pixels per byte, width bytes per page
+	uint8_t buffer[SSD1306_MAXWIDTH * SSD1306_MAXHEIGHT / 8];
+	// what the display RAM holds, i.e. the last framebuffer sent
+	uint8_t shadow[SSD1306_MAXWIDTH * SSD1306_MAXHEIGHT / 8];
+} ssd1306_ctx;
+
+int ssd1306_init(ssd1306_ctx *ctx, int width, int height);
+int ssd1306_begin(ssd1306_ctx *ctx, unsigned int switchvcc, unsigned int i2caddr); //switchvcc should be SSD1306_SWITCHCAPVCC
+void ssd1306_end(ssd1306_ctx *ctx);
+void ssd1306_setReinitOnError(ssd1306_ctx *ctx, unsigned int enable);
+void ssd1306_setBus(ssd1306_ctx *ctx, struct I2cBus *bus);
+void ssd1306_command(ssd1306_ctx *ctx, unsigned int c);
+
+void ssd1306_clearDisplay(ssd1306_ctx *ctx);
+void ssd1306_invertDisplay(ssd1306_ctx *ctx, unsigned int i);
+int ssd1306_display(ssd1306_ctx *ctx);
+void ssd1306_invalidate(ssd1306_ctx *ctx);
+void ssd1306_setChunkSize(ssd1306_ctx *ctx, int size);
+
+void ssd1306_startscrollright(ssd1306_ctx *ctx, unsigned int start, unsigned int stop);
+void ssd1306_startscrollleft(ssd1306_ctx *ctx, unsigned int start, unsigned int stop);
+
+void ssd1306_startscrolldiagright(ssd1306_ctx *ctx, unsigned int start, unsigned int stop);
+void ssd1306_startscrolldiagleft(ssd1306_ctx *ctx, unsigned int start, unsigned int stop);
+void ssd1306_stopscroll(ssd1306_ctx *ctx);
+
+void ssd1306_dim(ssd1306_ctx *ctx, unsigned int dim);
+void ssd1306_sleep(ssd1306_ctx *ctx, unsigned int sleep);
+int ssd1306_setRamHeight(ssd1306_ctx *ctx, int rows);
+void ssd1306_setStartLine(ssd1306_ctx *ctx, int line);
+
+void ssd1306_drawPixel(ssd1306_ctx *ctx, int x, int y, unsigned int color);
+
+void ssd1306_drawFastVLine(ssd1306_ctx *ctx, int x, int y, int h, unsigned int color);
+void ssd1306_drawFastHLine(ssd1306_ctx *ctx, int x, int y, int w, unsigned int color);
+
+void ssd1306_fillRect(ssd1306_ctx *ctx, int x, int y, int w, int h, int fillcolor);
+
+void ssd1306_setTextSize(ssd1306_ctx *ctx, int s);
+void ssd1306_drawString(ssd1306_ctx *ctx, char *str);
+void ssd1306_drawText(ssd1306_ctx *ctx, int x, int y, char *str);
+void ssd1306_drawChar(ssd1306_ctx *ctx, int x, int y, unsigned char c, int color, int size);
 
 #endif				/* _SSD1306_I2C_H_ */
@@ -0,0 +1,372 @@
+//------------------------------------------------------------------------------
+//  File: 	stress.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Stress tests, see stress.h.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "stress.h"
+#include "mailbox.h"
+#include "history.h"
+
+#define STRESS_WORDS		16	// 64-bit words per mailbox value
+#define STRESS_WAIT_EVERY	64	// mailbox polls per mailboxWait
+#define STRESS_READ		64	// history records per read
+
+typedef struct StressValue
+{
+    uint64_t	words	[ STRESS_WORDS ];	// words[ 0 ] is the sequence
+} StressValue;
+
+typedef struct MailboxStress
+{
+    Mailbox	mailbox;
+    long	publishes;
+    atomic_bool	bDone;		// the producer published its last value
+} MailboxStress;
+
+typedef struct HistoryStress
+{
+    History	history;
+    long	appends;
+    atomic_bool	bDone;		// the writer appended its last record
+} HistoryStress;
+
+typedef struct HistoryReader
+{
+    HistoryStress* pStress;
+    int		returnValue;
+    unsigned long nReads;
+    unsigned long nRecords;	// records copied
+    unsigned long nOvertaken;	// reads that lost records during the copy
+} HistoryReader;
+
+
+//------------------------------------------------------------------------------
+//  static uint64_t stressWord( uint64_t sequence, int i )
+//	Returns word i of value sequence
+//------------------------------------------------------------------------------
+static uint64_t stressWord( uint64_t sequence, int i )
+{
+    return (i == 0) ? sequence : sequence * 0x9e3779b97f4a7c15ULL + i;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void* mailboxProducer( void* pArg )
+//	Publish the values 1 .. publishes as fast as possible.
+//------------------------------------------------------------------------------
+static void* mailboxProducer( void* pArg )
+{
+    MailboxStress*	pStress = pArg;
+    long		n;
+    int			i;
+
+    for ( n = 1; n <= pStress->publishes; n++ )
+    {
+	StressValue* pValue = mailboxBack( &pStress->mailbox );
+
+	for ( i = 0; i < STRESS_WORDS; i++ )
+	{
+	    pValue->words[ i ] = stressWord( n, i );
+	}
+	mailboxPublish( &pStress->mailbox );
+    }
+    atomic_store( &pStress->bDone, true );
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int checkValue( const StressValue* pValue, bool bFresh,
+//			   uint64_t* pLast )
+//	Check that pValue is whole, and newer than *pLast if fresh or the same
+//	value otherwise; *pLast is set to its sequence.
+//	Returns 0 if the value is right, -1 otherwise
+//------------------------------------------------------------------------------
+static int checkValue( const StressValue* pValue, bool bFresh, uint64_t* pLast )
+{
+    uint64_t	sequence = pValue->words[ 0 ];
+    int		i;
+
+    for ( i = 1; i < STRESS_WORDS; i++ )
+    {
+	if ( pValue->words[ i ] != stressWord( sequence, i ))
+	{
+	    fprintf( stderr, "mailbox: value %llu is torn\n",
+		     (unsigned long long)sequence );
+	    return -1;
+	}
+    }
+    if ( bFresh ? sequence <= *pLast : sequence != *pLast )
+    {
+	fprintf( stderr, "mailbox: %s value %llu after %llu\n",
+		 bFresh ? "fresh" : "old", (unsigned long long)sequence,
+		 (unsigned long long)*pLast );
+	return -1;
+    }
+    *pLast = sequence;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int stressMailbox( long publishes )
+//	Pass publishes values from a producer thread to a consumer that
+//	checks each value it takes, and that the last one arrives.
+//	Returns 0 if all values were right, -1 otherwise
+//------------------------------------------------------------------------------
+int stressMailbox( long publishes )
+{
+    static MailboxStress stress;
+    pthread_t		producer;
+    uint64_t		last = 0;
+    unsigned long	nFresh = 0;
+    unsigned long	nPolls = 0;
+    int			returnValue = 0;
+    bool		bDone = false;
+
+    stress.publishes = publishes;
+    atomic_init( &stress.bDone, false );
+    if ( mailboxInit( &stress.mailbox, sizeof( StressValue )) != 0 )
+    {
+	return -1;
+    }
+    if ( pthread_create( &producer, NULL, mailboxProducer, &stress ) != 0 )
+    {
+	fprintf( stderr, "Could not start producer thread\n" );
+	mailboxClose( &stress.mailbox );
+	return -1;
+    }
+
+    // The value after the producer is done must be its last one
+    while ( returnValue == 0 && (!bDone || last != (uint64_t)publishes) )
+    {
+	const StressValue*	pValue;
+	bool			bFresh;
+
+	bDone = atomic_load( &stress.bDone );
+	if ( ++nPolls % STRESS_WAIT_EVERY == 0 )
+	{
+	    mailboxWait( &stress.mailbox, 0 );
+	}
+	pValue = mailboxLatest( &stress.mailbox, &bFresh );
+	if ( pValue == NULL )
+	{
+	    continue;
+	}
+	if ( bDone && !bFresh && last != (uint64_t)publishes )
+	{
+	    fprintf( stderr, "mailbox: last value %llu never arrived\n",
+		     (unsigned long long)publishes );
+	    returnValue = -1;
+	    break;
+	}
+	nFresh += bFresh;
+	returnValue = checkValue( pValue, bFresh, &last );
+    }
+
+    pthread_join( producer, NULL );
+    mailboxClose( &stress.mailbox );
+
+    printf( "mailbox: %ld published, %lu taken in %lu polls: %s\n",
+	    publishes, nFresh, nPolls, returnValue == 0 ? "ok" : "FAILED" );
+    return returnValue;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void fillRecord( HistoryRecord* pRecord, uint64_t n )
+//	Fill record number n with values that all derive from n.
+//------------------------------------------------------------------------------
+static void fillRecord( HistoryRecord* pRecord, uint64_t n )
+{
+    int i;
+
+    pRecord->time = (uint32_t)n;
+    pRecord->temperature = (int16_t)(n * 7);
+    for ( i = 0; i < HISTORY_ZONES; i++ )
+    {
+	pRecord->zones[ i ] = (int16_t)(n >> (8 * i));
+    }
+    pRecord->fanValue = (uint8_t)(n * 3);
+    pRecord->cpuLoad = (uint8_t)(n >> 5);
+}
+
+
+//------------------------------------------------------------------------------
+//  static void* historyWriter( void* pArg )
+//	Append records 0 .. appends - 1 as fast as possible.
+//------------------------------------------------------------------------------
+static void* historyWriter( void* pArg )
+{
+    HistoryStress*	pStress = pArg;
+    HistoryRecord	record;
+    long		n;
+
+    for ( n = 0; n < pStress->appends; n++ )
+    {
+	fillRecord( &record, n );
+	historyAppend( &pStress->history, &record );
+    }
+    atomic_store( &pStress->bDone, true );
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int checkRead( const HistoryStress* pStress, uint64_t first,
+//			  uint64_t headBefore, const HistoryRecord* pRecords,
+//			  int nRead, uint64_t firstRead, bool* pbOvertaken )
+//	Check a read that asked for records from first when the history held
+//	headBefore records, and got nRead from record firstRead: the records
+//	must be whole and consecutive, and start at first or at the oldest
+//	record still there. *pbOvertaken is set to whether the writer
+//	overwrote records during the copy, so they were left out.
+//	Returns 0 if the read is right, -1 otherwise
+//------------------------------------------------------------------------------
+static int checkRead( const HistoryStress* pStress, uint64_t first,
+		      uint64_t headBefore, const HistoryRecord* pRecords,
+		      int nRead, uint64_t firstRead, bool* pbOvertaken )
+{
+    uint32_t		capacity = pStress->history.capacity;
+    uint64_t		oldest = (headBefore >= capacity) ?
+				 headBefore - capacity + 1 : 0;
+    uint64_t		start = (first > oldest) ? first : oldest;
+    HistoryRecord	expected;
+    int			i;
+
+    if ( firstRead < start )
+    {
+	fprintf( stderr, "history: read from %llu, asked %llu, oldest %llu\n",
+		 (unsigned long long)firstRead, (unsigned long long)first,
+		 (unsigned long long)oldest );
+	return -1;
+    }
+    *pbOvertaken = firstRead > start;
+
+    for ( i = 0; i < nRead; i++ )
+    {
+	fillRecord( &expected, firstRead + i );
+	if ( memcmp( &pRecords[ i ], &expected, sizeof( expected )) != 0 )
+	{
+	    fprintf( stderr, "history: record %llu is wrong (time %lu)\n",
+		     (unsigned long long)(firstRead + i),
+		     (unsigned long)pRecords[ i ].time );
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void* historyReader( void* pArg )
+//	Read the history until the writer is done, alternately from the
+//	oldest record, which the writer overtakes during the copy, and from
+//	the newest ones, and check every read.
+//------------------------------------------------------------------------------
+static void* historyReader( void* pArg )
+{
+    HistoryReader*	pReader = pArg;
+    HistoryStress*	pStress = pReader->pStress;
+    HistoryRecord	records	[ STRESS_READ ];
+    uint32_t		capacity = pStress->history.capacity;
+    bool		bDone = false;
+
+    while ( pReader->returnValue == 0 && !bDone )
+    {
+	uint64_t	head;
+	uint64_t	first;
+	uint64_t	firstRead;
+	bool		bOvertaken = false;
+	int		nRead;
+
+	bDone = atomic_load( &pStress->bDone );
+	head = historyCount( &pStress->history );
+	if ( pReader->nReads % 2 == 0 )
+	{
+	    first = (head >= capacity) ? head - capacity + 1 : 0;
+	}
+	else
+	{
+	    first = (head >= STRESS_READ) ? head - STRESS_READ : 0;
+	}
+
+	nRead = historyRead( &pStress->history, first, records, STRESS_READ,
+			     &firstRead );
+	pReader->returnValue = checkRead( pStress, first, head, records,
+					  nRead, firstRead, &bOvertaken );
+	pReader->nReads++;
+	pReader->nRecords += nRead;
+	pReader->nOvertaken += bOvertaken;
+    }
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+//  int stressHistory( long appends )
+//	Append records to a small history from a writer thread, while reader
+//	threads copy and check records.
+//	Returns 0 if all reads were right, -1 otherwise
+//------------------------------------------------------------------------------
+int stressHistory( long appends )
+{
+    static HistoryStress stress;
+    HistoryReader	readers	[ STRESS_READERS ];
+    pthread_t		writer;
+    pthread_t		threads	[ STRESS_READERS ];
+    int			nThreads;
+    int			returnValue = 0;
+    int			i;
+
+    stress.appends = appends;
+    atomic_init( &stress.bDone, false );
+    if ( historyInit( &stress.history, STRESS_HISTORY_CAPACITY ) != 0 )
+    {
+	return -1;
+    }
+    if ( pthread_create( &writer, NULL, historyWriter, &stress ) != 0 )
+    {
+	fprintf( stderr, "Could not start writer thread\n" );
+	historyClose( &stress.history );
+	return -1;
+    }
+    for ( nThreads = 0; nThreads < STRESS_READERS; nThreads++ )
+    {
+	memset( &readers[ nThreads ], 0, sizeof( readers[ nThreads ] ));
+	readers[ nThreads ].pStress = &stress;
+	if ( pthread_create( &threads[ nThreads ], NULL, historyReader,
+			     &readers[ nThreads ] ) != 0 )
+	{
+	    fprintf( stderr, "Could not start reader thread\n" );
+	    returnValue = -1;
+	    break;
+	}
+    }
+
+    pthread_join( writer, NULL );
+    for ( i = 0; i < nThreads; i++ )
+    {
+	pthread_join( threads[ i ], NULL );
+	returnValue |= readers[ i ].returnValue;
+	printf( "history reader %d: %lu reads, %lu records, %lu overtaken\n",
+		i, readers[ i ].nReads, readers[ i ].nRecords,
+		readers[ i ].nOvertaken );
+    }
+    historyClose( &stress.history );
+
+    printf( "history: %ld appended: %s\n", appends,
+	    returnValue == 0 ? "ok" : "FAILED" );
+    return returnValue;
+}
@@ -0,0 +1,30 @@
+//------------------------------------------------------------------------------
+//  File: 	stress.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Stress tests of the lock-free structures between the threads of the
+//  daemon. A producer thread runs flat out against a consumer that checks
+//  every value it gets. Each value is built from its sequence number, so a
+//  value that was torn or handed over out of order is detected; the test
+//  returns -1 on the first error.
+//
+//  The tests are meant to be run on a build with ThreadSanitizer as well:
+//	gcc -g -O1 -fsanitize=thread -o tempcontrol-tsan <source files> -pthread
+//	./tempcontrol-tsan -t mailboxStress
+//	./tempcontrol-tsan -t historyStress
+//
+//------------------------------------------------------------------------------
+#ifndef STRESS_H
+#define STRESS_H
+
+#define STRESS_PUBLISHES	2000000	// values through the mailbox
+#define STRESS_APPENDS		5000000	// records through the history
+#define STRESS_HISTORY_CAPACITY	256	// small, so readers are overtaken
+#define STRESS_READERS		2	// history reader threads
+
+int	stressMailbox( long publishes );
+int	stressHistory( long appends );
+
+#endif
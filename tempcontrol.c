@@ -7,6 +7,28 @@
 //  Measured temperature is divided into a number of temperature ranges and for
 //  each range, specific settings for fan speed and led colors on the Smart 
 //  Cooling Hat (DF-DFR0672) are defined.
+//  The ranges are kept in a table (fanpolicy.c). A built-in table is used
+//  unless a config file is supplied with:
+//	tempcontrol -c <config file>
+//  The config file is read again when the program receives SIGHUP.
+//  A hotter range is applied right away. A cooler range only after the current
+//  range has been applied for a minimum dwell time, and once the temperature
+//  is a hysteresis below the range boundary, so the fan does not hunt when
+//  the temperature sits on a boundary.
+//  Optionally, the range is selected for the temperature predicted from its
+//  slope and the rise of the CPU utilization, so the fan speeds up before a
+//  burst of load reaches the throttle point ("predict" in the config file).
+//
+//  Instead of the ranges, a PID controller can drive the fan speed, using all
+//  steps of the fan register to hold the temperature at a setpoint:
+//	tempcontrol -m pid [-S <setpoint C>]
+//  The ranges then only select the led color.
+//
+//  As a systemd service (tempcontrol.service, Type=notify) readiness is
+//  reported and the watchdog is pinged from the control loop (sdnotify.c).
+//  On SIGTERM the loop ends with the fan at full speed, and
+//	tempcontrol -t fanFull
+//  does only that, for after a crash.
 //
 //  The program can run in test mode by supplying a startup argument, either of:
 //	tempcontrol -t sweepTemperatures
@@ -16,76 +38,200 @@
 //  steps through the values 30 through 65 degrees celsius and controls fan
 //  and led setttings accordingly.
 //  In the second test, the program steps through the defined temperature ranges
+//  of the table
+//
+//  The controller can be run on a recorded trace of temperatures (a sample
+//  log or a text file, see simulate.h) as fast as possible, to evaluate the
+//  ranges or the PID gains, with:
+//	tempcontrol [-c <config file>] [-m pid] -t simulate -i <trace>
+//  It prints the range transitions, the time in each range and the fan duty.
+//  The hat is then driven through the mock I2C backend; with
+//  -b mock=<record file> the display is drawn as well and all transfers are
+//  recorded, with the simulated time.
+//
+//  The hot paths of the display and the range selection are timed, without
+//  using the hardware, with (benchmark.c):
+//	tempcontrol [-c <config file>] -t benchmark
+//
+//  The lock-free mailbox between the control loop and its workers, and the
+//  history ring, are checked by a producer and consumer threads running
+//  flat out, preferably on a build with -fsanitize=thread (stress.c), with:
+//	tempcontrol -t mailboxStress
+//	tempcontrol -t historyStress
+//
+//  In normal operation the temperature is sampled every 500 ms, the OLED is
+//  refreshed every 2 seconds and slowly changing properties (disk space, IP
+//  address) are refreshed every 5 minutes. The periods can be changed with:
+//	tempcontrol -p <sample period ms> -d <display period ms>
+//		    -s <slow property period s>
+//  Every second, the temperatures, fan register and CPU utilization are
+//  recorded in an in-memory history of the last 24 hours (history.c). They
+//  can also be logged to a binary file (samplelog.c), which is flushed once
+//  a minute:
+//	tempcontrol -l <log file>
+//  and printed as text with:
+//	tempcontrol -l <log file> -t dumpLog
+//  The state of the control loop can be scraped by Prometheus from
+//  http://<host>:<port>/metrics (exporter.c) with:
+//	tempcontrol -e <port>
+//
+//  The control temperature is taken from all thermal zones and hwmon
+//  temperature inputs of the board. By default the hottest zone counts; a
+//  weighted average of named zones can be selected instead with:
+//	tempcontrol -z <zone>=<weight>[,<zone>=<weight>...]
+//  The zone names are listed on stderr at startup.
+//
+//  The I2C transfers are made with the adapter device /dev/i2c-1 by default.
+//  Another adapter or backend (i2cbackend.c) can be selected with:
+//	tempcontrol -b i2c=<device>|wiringPi[=<device>]|mock[=<record file>]
+//  The mock backend needs no hat; it can record every transfer to a file.
+//  The wiringPi backend is only available when built with -DUSE_WIRINGPI;
+//  otherwise the program does not need wiringPi at all.
 //
 //  The OLED display on the Smart Cooling Hat displays the following properties:
-//	- CPU utilization
-//	- Total RAM and free RAM
+//	- CPU temperature, in a large font
+//	- CPU utilization, from /proc/stat (cpustat.c)
+//	- RAM in use, in percent
 //	- Total and free Disk space
 //	- IP address
-//	- CPU temperature
+//  It alternates with a page showing the temperature history of the last
+//  127 seconds as a sparkline. "THR" is shown while the firmware limits the
+//  ARM clock (throttle.c). With
+//	tempcontrol -T
+//  the hottest range (or full fan speed in PID mode) is applied while the
+//  firmware throttles or holds the soft temperature limit.
 //
 //------------------------------------------------------------------------------
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/sysinfo.h>
 #include <fcntl.h>
 
-#include <ifaddrs.h>
-#include <netinet/in.h>
-#include <string.h>
-#include <arpa/inet.h>
-#include <sys/vfs.h>
-
-// Wiring library specifications
-#include <wiringPi.h>
-#include <wiringPiI2C.h>
-
 #include "ssd1306_i2c.h"
-
-//  This file contains current temperature:
-#define TEMP_PATH "/sys/class/thermal/thermal_zone0/temp"
-
-#define MAX_SIZE 	32
-#define MAX_LED  	3
-#define MAX_RANGE  	7
-
-enum TempRange
+#include "scheduler.h"
+#include "metrics.h"
+#include "thermal.h"
+#include "fanpolicy.h"
+#include "pid.h"
+#include "coolinghat.h"
+#include "i2cbus.h"
+#include "display.h"
+#include "history.h"
+#include "samplelog.h"
+#include "exporter.h"
+#include "cpustat.h"
+#include "throttle.h"
+#include "benchmark.h"
+#include "stress.h"
+#include "simulate.h"
+#include "sdnotify.h"
+
+enum ControlMode
 {
-    TempBelow40 = 0,
-    Temp40To45 =  1,
-    Temp45To47 =  2,
-    Temp47To49 =  3,
-    Temp49To51 =  4,
-    Temp51To53 =  5,
-    TempAbove53 = 6
+    ControlStep = 0,	// fan speed of the temperature range
+    ControlPid =  1	// fan speed of the PID controller
 };
 
-// Gobal values
-int 	gFileI2C= 0;
+// Default scheduler periods
+#define SAMPLE_PERIOD_MS	500	// temperature sample and fan decision
+#define DISPLAY_PERIOD_MS	2000	// OLED refresh
+#define SLOW_PERIOD_S		300	// disk space and IP address
+#define HISTORY_PERIOD_MS	1000	// history record
+#define THROTTLE_PERIOD_MS	1000	// firmware throttle flags
 
-double 	gTemperature = 0.0; // CPU temperature
-FILE*	pFileTemperature = NULL;
+// Gobal values
+I2cBus	gBus;			// I2C bus of the hat and the OLED display
+CoolingHat gHat;		// Fan and leds on the Smart Cooling Hat
+
+double 	gTemperature = 0.0; // Control temperature of all zones
+Thermal	gThermal;		// Thermal zones and hwmon inputs
+CpuStat	gCpuStat;		// CPU utilization, sampled with the temperature
+const I2cBackend* gpBackend = &gI2cBackendIoctl; // Transfers of gBus
+const char* gpBusPath = NULL;	// Adapter or record file of gpBackend
+Throttle gThrottle;		// Firmware throttle flags and ARM clock
+bool	gbThrottleBoost = false; // -T: full cooling while throttled
+const char* gpZoneWeights = "max"; // How the zones are combined
+
+ssd1306_ctx gDisplay;		// OLED display on the Smart Cooling Hat
+DisplayText gDisplayText;	// Text page of gDisplay for showProperties
+DisplayWorker gDisplayWorker;	// Draws gDisplay in runControlLoop
+
+int	gSamplePeriodMs = SAMPLE_PERIOD_MS;
+int	gDisplayPeriodMs = DISPLAY_PERIOD_MS;
+int	gSlowPeriodS = SLOW_PERIOD_S;
+
+FanPolicy   gPolicy;		// Temperature ranges with their settings
+const char* gpConfigPath = NULL; // Config file of gPolicy, if any
+FanState    gFanState = { -1, 0 }; // Range that is applied, with hysteresis
+double	gPredictedTemperature = 0.0; // Of the range selection, see controlStep
+
+enum ControlMode gControlMode = ControlStep;
+FanPid	gPid;			// Controller of ControlPid mode
+double	gSetpoint = -1.0;	// -S setpoint, or -1 for the config file one
+int	gFanValue = -1;		// Fan register value applied, -1 if none yet
+int	gLedRange = -1;		// Range of the led color applied, -1 if none yet
+
+Metrics	gMetrics;		// Disk space and IP address
+History	gHistory;		// Recent temperature, fan and CPU samples
+SampleLog gSampleLog;		// Binary log of the samples, if any
+const char* gpLogPath = NULL;	// File of gSampleLog
+
+Exporter gExporter;		// Prometheus endpoint, if any
+int	gExporterPort = 0;	// -e port, 0 for none
+unsigned long gBandChanges = 0;	// Range transitions
+ExporterHistogram gSampleDuration; // Timing of onSampleTimer
+ExporterHistogram gSampleLateness;
+long long gLastSampleUs = 0;	// Start of the previous onSampleTimer
+
+SdNotify gNotify;		// Readiness and watchdog of the systemd service
+
+const char* gpTracePath = NULL;	// -i trace of the simulation
+long long gSimulatedUs = 0;	// Clock of the simulation
 
 // Forward declarations
-int    	read( int fd, char* buf, int count );
-int    	close( int fd );
-
-void   	setRGB( int fd, int num, int R, int G, int B );
-void   	closeRGB( int fd );
-
-enum TempRange 	temperatureRange( const double temperature );
+int 	temperatureRange( const double temperature );
 int	init();
-int 	setTempControls( enum TempRange tempRange, bool verbose );
+int 	setTempControls( int tempRange, bool verbose );
+void	setCoolingHat( int fanValue, const FanBand* pColor );
+void	initPid();
+void	controlStep( long long nowMs ); // Fan decision of onSampleTimer
+void	runPid( long long nowMs );
+double	predictTemperature();	// Feed-forward of the range selection
+bool	throttleBoost();	// Full cooling because of throttling
 int	runControlLoop();	// Normal temperature control
 int 	updateTemperature(); 	// Refresh CPU temperature in gTemperature
 int	sweepTemperatures();    // Step through temperatures from 30 to 60 C
 int	sweepTempRanges();      // Step through the defined temperature ranges
+void	sleepMs( int ms );	// Pause of the test modes
+int	simulate();		// Run the controller on the -i trace
+void	simulateHistory( const TraceSample* pPrevious,
+			 const TraceSample* pSample, double startS,
+			 long long* pNextMs );
+long long simulatedClockUs();
 int	showProperties();	// Display properties on oled display
+void	fillSnapshot( DisplaySnapshot* pSnapshot );
+void	onSampleTimer( void* pArg );	// Scheduler tasks of runControlLoop
+void	onDisplayTimer( void* pArg );
+void	onSlowTimer( void* pArg );
+void	onHistoryTimer( void* pArg );
+void	onLogSyncTimer( void* pArg );
+void	onThrottleTimer( void* pArg );
+void	onWatchdogTimer( void* pArg );
+void	onTerminateSignal( void* pArg );
+int	setFanFull();		// Safe state when the control loop ends
+void	fillRecord( HistoryRecord* pRecord );
+void	fillExporterSnapshot( ExporterSnapshot* pSnapshot );
+void	onReloadSignal( void* pArg );
+int	parseBackend( char* pArg );
+void	printUsage();
 
 
 //------------------------------------------------------------------------------
@@ -95,231 +241,385 @@ int	showProperties();	// Display properties on oled display
 //------------------------------------------------------------------------------
 int main( int argc, char* argv[] )
 {
-    if ( init() != 0 )
+    const char*	pTestName = NULL;
+    int		option;
+
+    while ( (option = getopt( argc, argv, "t:c:m:S:p:d:s:z:l:e:Tb:i:" )) != -1 )
     {
-    	fprintf( stderr, "Init failed\n" );
-    } else if ( argc == 1 )
+	switch ( option )
+	{
+	    case 't':
+		pTestName = optarg;
+		break;
+
+	    case 'c':
+		gpConfigPath = optarg;
+		break;
+
+	    case 'm':
+		if ( !strcmp( optarg, "pid" ))
+		{
+		    gControlMode = ControlPid;
+		}
+		else if ( !strcmp( optarg, "step" ))
+		{
+		    gControlMode = ControlStep;
+		}
+		else
+		{
+		    printUsage();
+		    return -1;
+		}
+		break;
+
+	    case 'S':
+		gSetpoint = atof( optarg );
+		break;
+
+	    case 'p':
+		gSamplePeriodMs = atoi( optarg );
+		break;
+
+	    case 'd':
+		gDisplayPeriodMs = atoi( optarg );
+		break;
+
+	    case 's':
+		gSlowPeriodS = atoi( optarg );
+		break;
+
+	    case 'z':
+		gpZoneWeights = optarg;
+		break;
+
+	    case 'l':
+		gpLogPath = optarg;
+		break;
+
+	    case 'e':
+		gExporterPort = atoi( optarg );
+		break;
+
+	    case 'T':
+		gbThrottleBoost = true;
+		break;
+
+	    case 'i':
+		gpTracePath = optarg;
+		break;
+
+	    case 'b':
+		if ( parseBackend( optarg ) != 0 )
+		{
+		    printUsage();
+		    return -1;
+		}
+		break;
+
+	    default:
+		printUsage();
+		return -1;
+	}
+    }
+
+    if ( optind != argc || gSamplePeriodMs <= 0 || gDisplayPeriodMs <= 0 ||
+	 gSlowPeriodS <= 0 || (gSetpoint < 0.0 && gSetpoint != -1.0) ||
+	 gExporterPort < 0 || gExporterPort > 65535 )
     {
-	// No arguments supplied: run normal control loop
-	return runControlLoop();
-    } 
+	printUsage();
+	return -1;
+    }
+
+    // Reading a log needs no hardware
+    if ( pTestName != NULL && !strcmp( pTestName, "dumpLog" ))
+    {
+	if ( gpLogPath == NULL )
+	{
+	    printUsage();
+	    return -1;
+	}
+	return sampleLogDump( gpLogPath, stdout );
+    }
+
+    // Only sets the fan, e.g. after the service stopped or crashed
+    if ( pTestName != NULL && !strcmp( pTestName, "fanFull" ))
+    {
+	return setFanFull();
+    }
+
+    // The benchmark drives a null bus, not the hardware
+    if ( pTestName != NULL && !strcmp( pTestName, "benchmark" ))
+    {
+	policyDefault( &gPolicy );
+	if ( gpConfigPath != NULL && policyLoad( &gPolicy, gpConfigPath ) != 0 )
+	{
+	    return -1;
+	}
+	return benchmarkRun( &gPolicy, BENCH_ITERATIONS );
+    }
 
-    // Illegal arguments; should be either
-    //     	-t sweepTemperatures, or
-    //		-t sweepTempRanges    
+    // The stress tests only use memory and threads
+    if ( pTestName != NULL && !strcmp( pTestName, "mailboxStress" ))
+    {
+	return stressMailbox( STRESS_PUBLISHES );
+    }
+    if ( pTestName != NULL && !strcmp( pTestName, "historyStress" ))
+    {
+	return stressHistory( STRESS_APPENDS );
+    }
 
-    if ( (argc != 3) || strcmp( argv[1], "-t" )) 
+    // The simulation replays a trace, on the mock backend
+    if ( pTestName != NULL && !strcmp( pTestName, "simulate" ))
+    {
+	if ( gpTracePath == NULL )
+	{
+	    printUsage();
+	    return -1;
+	}
+	return simulate();
+    }
+
+    if ( init() != 0 )
     {
-        fprintf( stderr, "Usage:\n" );
-        fprintf( stderr, "\t tempcontrol, or\n" );
-        fprintf( stderr, "\t tempcontrol -t sweepTempRanges, or\n" );
-        fprintf( stderr, "\t tempcontrol -t sweepTemperatures\n" );
+    	fprintf( stderr, "Init failed\n" );
 	return -1;
     }
 
-    if ( !strcmp( argv[2], "sweepTemperatures" ))
+    if ( pTestName == NULL )
+    {
+	// No test requested: run normal control loop
+	return runControlLoop();
+    } 
+    else if ( !strcmp( pTestName, "sweepTemperatures" ))
     {
 	fprintf( stderr, "sweepTemperatures\n" );
 	return sweepTemperatures();
     }
-    else if ( !strcmp( argv[2], "sweepTempRanges" ) )
+    else if ( !strcmp( pTestName, "sweepTempRanges" ) )
     {
 	fprintf( stderr, "sweepTempRanges\n" );
 	return sweepTempRanges();
     }
     else 
     {
-	fprintf( stderr, "unknown option %s\n", argv[2] );
+	fprintf( stderr, "unknown option %s\n", pTestName );
 	return -1;
     }
 }
 
 
 //------------------------------------------------------------------------------
-//  int init();
-//
-//    Open files for I2C controls and cpu temperature reading.
-//    Return 0 if both files could be opened succesfully, -1 otherwise
+//  void printUsage()
+//	Print the command line options on stderr
 //------------------------------------------------------------------------------
-int  init()
+void printUsage()
 {
-    int returnValue = 0;
+    fprintf( stderr, "Usage:\n" );
+    fprintf( stderr, "\t tempcontrol [-c configFile] [-p sampleMs] "
+		     "[-d displayMs] [-s slowS]\n" );
+    fprintf( stderr, "\t\t [-z max|zone=weight,...] "
+		     "[-m step|pid] [-S setpointC] [-l logFile]\n" );
+    fprintf( stderr, "\t\t [-e exporterPort] [-T] "
+		     "[-b i2c|wiringPi|mock[=path]], or\n" );
+    fprintf( stderr, "\t tempcontrol [-c configFile] -t sweepTempRanges, or\n" );
+    fprintf( stderr, "\t tempcontrol [-c configFile] [-l logFile] "
+		     "-t sweepTemperatures, or\n" );
+    fprintf( stderr, "\t tempcontrol -l logFile -t dumpLog, or\n" );
+    fprintf( stderr, "\t tempcontrol [-c configFile] [-m step|pid] "
+		     "[-b mock=recordFile] -t simulate -i trace, or\n" );
+    fprintf( stderr, "\t tempcontrol [-c configFile] -t benchmark, or\n" );
+    fprintf( stderr, "\t tempcontrol -t mailboxStress|historyStress, or\n" );
+    fprintf( stderr, "\t tempcontrol [-b backend] -t fanFull\n" );
+}
 
-    // Initialize I2C fan control
-    wiringPiSetup();
-    gFileI2C = wiringPiI2CSetup( 0x0d );
-    if ( gFileI2C < 0 )
+
+//------------------------------------------------------------------------------
+//  int parseBackend( char* pArg )
+//	Select the I2C backend of the -b argument <backend>[=<path>].
+//	Returns 0 on success, -1 if there is no such backend
+//------------------------------------------------------------------------------
+int parseBackend( char* pArg )
+{
+    char* pPath = strchr( pArg, '=' );
+
+    if ( pPath != NULL )
     {
-        fprintf( stderr, "Could not init I2C\n" );
-        returnValue = -1;
+	*pPath++ = '\0';
     }
-
-    // Open CPU temperature file
-    pFileTemperature = fopen( TEMP_PATH, "r");
-    if ( pFileTemperature == NULL )
+    gpBackend = i2cBackendFind( pArg );
+    gpBusPath = pPath;
+    if ( gpBackend == NULL )
     {
-        fprintf( stderr, "Could not open temperature file\n" );
-        returnValue = -1;	
+	fprintf( stderr, "Unknown I2C backend %s\n", pArg );
+	return -1;
     }
-
-    return returnValue;
+    return 0;
 }
 
 
 //------------------------------------------------------------------------------
-//  enum TempRange temperatureRange( double temperature );
+//  int init();
 //
-//    This function returns the TempRange, the supplied temperature (degrees 
-//    Celsius) lies in.
+//    Open files for I2C controls and cpu temperature reading and start the
+//    OLED display session.
+//    Return 0 if both files could be opened succesfully, -1 otherwise
 //------------------------------------------------------------------------------
-enum TempRange temperatureRange( const double temperature )
+int  init()
 {
-    enum TempRange tempRange = TempAbove53;
+    int returnValue = 0;
 
-    if ( temperature < 40 )
+    // Initialize I2C fan control; the bus stays open and is shared with the
+    // OLED display, which yields to fan updates
+    if ( i2cBusOpen( &gBus, gpBackend, gpBusPath ) != 0 ||
+	 hatOpen( &gHat, &gBus, COOLINGHAT_I2C_ADDRESS ) != 0 )
     {
-	tempRange = TempBelow40;
-    }            
-    else if ( temperature < 45 )
+        fprintf( stderr, "Could not init I2C\n" );
+        returnValue = -1;
+    }
+
+    // Open the OLED display session once; it recovers by itself after I2C
+    // errors. A missing display is not fatal for temperature control.
+    ssd1306_init( &gDisplay, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT );
+    ssd1306_setBus( &gDisplay, &gBus );
+    if ( ssd1306_begin( &gDisplay, SSD1306_SWITCHCAPVCC,
+                        SSD1306_I2C_ADDRESS ) != 0 )
     {
-	tempRange = Temp40To45;
-      }
-    else if ( temperature < 47 )
+        fprintf( stderr, "Could not init OLED display\n" );
+    }
+    ssd1306_setReinitOnError( &gDisplay, true );
+    metricsInit( &gMetrics );
+
+    // Allocated once; recording does not allocate
+    if ( historyInit( &gHistory, HISTORY_CAPACITY ) != 0 )
     {
-	tempRange = Temp45To47;
+        returnValue = -1;
     }
-    else if ( temperature < 49 )
+
+    if ( gpLogPath != NULL &&
+	 sampleLogOpen( &gSampleLog, gpLogPath, SAMPLELOG_CAPACITY ) != 0 )
     {
-	tempRange = Temp47To49;
+        returnValue = -1;
     }
-    else if ( temperature < 51 )
+
+    // Temperature ranges
+    policyDefault( &gPolicy );
+    if ( gpConfigPath != NULL && policyLoad( &gPolicy, gpConfigPath ) != 0 )
     {
-	tempRange = Temp49To51;
+        returnValue = -1;
     }
-    else if ( temperature < 53 )
+    initPid();
+
+    // Open all temperature sensors
+    if ( thermalInit( &gThermal ) != 0 )
     {
-	tempRange = Temp51To53;
+        fprintf( stderr, "Could not find a temperature sensor\n" );
+        returnValue = -1;	
     }
-    else
+    else if ( thermalSetWeights( &gThermal, gpZoneWeights ) != 0 )
     {
-	tempRange = TempAbove53;
-    } 
+        returnValue = -1;
+    }
+
+    // CPU utilization and throttling are shown and logged, but not needed
+    // for control
+    cpuStatInit( &gCpuStat );
+    throttleInit( &gThrottle );
 
-    return tempRange;
+    return returnValue;
+}
+
+
+//------------------------------------------------------------------------------
+//  int temperatureRange( double temperature );
+//
+//    This function returns the index of the range in gPolicy, the supplied
+//    temperature (degrees Celsius) lies in.
+//------------------------------------------------------------------------------
+int temperatureRange( const double temperature )
+{
+    return policyBand( &gPolicy, temperature );
 }
 
 
 //------------------------------------------------------------------------------
-//  int setTempControls( TempRange  tempRange, bool verbose );
+//  int setTempControls( int tempRange, bool verbose );
 //
-//    This function sets fan speed and led colors for the supplied temp-range.
-//    TempBelow40: off
-//    Temp40To45:  20%
-//    Temp45To47:  40%
-//    Temp47To49:  60%
-//    Temp49To51:  80%
-//    Temp51To53:  90%
-//    TempAbove53: 100%
+//    This function sets fan speed and led colors for the supplied temp-range,
+//    as defined in gPolicy. With the built-in table:
+//    below 40 C:  off
+//    40 - 45 C:   20%
+//    45 - 47 C:   40%
+//    47 - 49 C:   60%
+//    49 - 51 C:   80%
+//    51 - 53 C:   90%
+//    above 53 C:  100%
 //
 //  The LED color on the Smart Cooling Hat is changed accordingly.
 //
-//  Selected system properties are displayed on the OLED display on the Smart 
-//  Cooling Hat.
-//
 //  Only if verbose is true, will the value of temp-range be printed on stdout.
-//  The return value is 0, unless the I2C interface could not be initialized.
+//  The return value is 0, unless temp-range is not in the table.
 //------------------------------------------------------------------------------
-int setTempControls( enum TempRange tempRange, bool verbose )
+int setTempControls( int tempRange, bool verbose )
 {
-    int	 returnValue = 0;
-    if ( gFileI2C == 0 )
+    if ( tempRange < 0 || tempRange >= gPolicy.nBands )
     {
-	gFileI2C = wiringPiI2CSetup( 0x0d );
+	return -1;
     }
 
-    switch ( tempRange )
-    {
-	case TempBelow40: 
-	    // Switch off fan below 40 C
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x00 );
-	    setRGB( gFileI2C, MAX_LED, 0x00, 0x88, 0x00 );    
-	    break;
+    const FanBand* pBand = &gPolicy.bands[ tempRange ];
 
-	case Temp40To45: 
-	    // Below 45 C run at 20% fan speed
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x02 );
-	    setRGB( gFileI2C, MAX_LED, 0x00, 0x44, 0x44 );    
-	    break;
-    
-	case Temp45To47: 
-	    // Below 47 C run at 40% fan speed
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x04 );
-	    setRGB( gFileI2C, MAX_LED, 0x00, 0x00, 0x88 );    
-	    break;
-    
-	case Temp47To49: 
-	    // // Below 49 C run at 60% fan speed
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x06 );
-	    setRGB( gFileI2C, MAX_LED, 0x44, 0x00, 0x44 );    
-	    break;
-    
-	case Temp49To51: 
-	    // Below 51 C run at 80% fan speed
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x08 );        
-	    setRGB( gFileI2C, MAX_LED, 0x88, 0x00, 0x00 );        
-	    break;
-    
-	case Temp51To53: 
-	    // Below 53 C run at 90% fan speed
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x09 );
-	    setRGB( gFileI2C, MAX_LED, 0xff, 0x00, 0x00 );    
-	    break;
-    
-	case TempAbove53: 
-	    // Above 53 degrees run fan at full speed
-	    wiringPiI2CWriteReg8( gFileI2C, 0x08, 0x01 );
-	    setRGB( gFileI2C, MAX_LED, 0xff, 0xff, 0xff );    
-	    break;
-    
-	default:
-	    returnValue = -1;
-        }
+    setCoolingHat( pBand->fanValue, pBand );
     
     if (verbose) printf("Settings applied for TempRange: %i\n", tempRange);
     
-    close( gFileI2C );
-    gFileI2C = 0;
-    return returnValue;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void setCoolingHat( int fanValue, const FanBand* pColor )
+//	Write fan register value fanValue and, if pColor is not NULL, the led
+//	color of pColor to the Smart Cooling Hat. The driver only writes the
+//	registers that changed.
+//------------------------------------------------------------------------------
+void setCoolingHat( int fanValue, const FanBand* pColor )
+{
+    hatSetFan( &gHat, fanValue );
+    if ( pColor != NULL )
+    {
+	hatSetRGB( &gHat, HAT_NUM_LEDS, pColor->red, pColor->green,
+		   pColor->blue );
+    }
 }
 
 
 //------------------------------------------------------------------------------
 //  int updateTemperature()
-//	Read the temperature of the Raspberry Pi device in degrees Celsius.
+//	Sample all temperature zones and combine them into the control
+//	temperature in degrees Celsius.
 //	If succesful, place the temperature in global variable gTemperature and
 //	return 0. Otherwise, return -1.
 //------------------------------------------------------------------------------
 int updateTemperature()
 {
-    char 	buf[MAX_SIZE];	
-    int		returnValue = 0;
-
-    rewind ( pFileTemperature );
-    fread ( &buf[ 0 ], 1, MAX_SIZE, pFileTemperature );
+    if ( thermalSample( &gThermal ) != 0 )
+    {
+	return -1;
+    }
 
-    // Convert to degrees celsius
-    gTemperature = atoi(buf) / 1000.0;
-    return returnValue;
+    gTemperature = gThermal.temperature;
+    return 0;
 }
 
 
 //------------------------------------------------------------------------------
 //  int sweepTemperatures()
 //	Steps through temperatures from 30 to 65 C
+//	Returns 0
 //------------------------------------------------------------------------------
 int sweepTemperatures()
 {
-    enum TempRange oldRange = TempAbove53;
+    int oldRange = -1;
     int i;
 
     for ( i =30 ; i < 65; i++ )
@@ -327,9 +627,19 @@ int sweepTemperatures()
 	gTemperature = i;
 	showProperties();
 
-	enum TempRange tempRange =  temperatureRange( gTemperature );
- 	fprintf( stderr, "Simulated temperature now: %.1f -- ", gTemperature );
- 	fprintf( stderr, "in range: %i\n", tempRange );
+	int tempRange =  temperatureRange( gTemperature );
+	if ( gpLogPath != NULL )
+	{
+	    HistoryRecord record;
+
+	    fillRecord( &record );
+	    sampleLogAppend( &gSampleLog, &record );
+	}
+	else
+	{
+	    fprintf( stderr, "Simulated temperature now: %.1f -- ", gTemperature );
+	    fprintf( stderr, "in range: %i\n", tempRange );
+	}
 
 	if ( tempRange != oldRange )
 	{
@@ -339,8 +649,14 @@ int sweepTemperatures()
 	}
 
 	// Check again in one second
-        delay( 1000 );
+        sleepMs( 1000 );
+    }
+
+    if ( gpLogPath != NULL )
+    {
+	sampleLogSync( &gSampleLog );
     }
+    return 0;
 }
 
 
@@ -354,17 +670,17 @@ int sweepTempRanges()
     int   i;
 
     // Descending order
-    for ( i = MAX_RANGE-1; i >= 0; i-- )
+    for ( i = gPolicy.nBands-1; i >= 0; i-- )
     {
-	setTempControls( (enum TempRange)i, true );
-        delay( 1000 );
+	setTempControls( i, true );
+        sleepMs( 1000 );
     }
 
     // Ascending order
-    for ( i = 0; i < MAX_RANGE; i++ )
+    for ( i = 0; i < gPolicy.nBands; i++ )
     {
-	setTempControls( (enum TempRange)i, true );
-        delay( 1000 );
+	setTempControls( i, true );
+        sleepMs( 1000 );
     }
     
     return 0;
@@ -372,166 +688,653 @@ int sweepTempRanges()
 
 
 //------------------------------------------------------------------------------
-//  runControlLoop()
-//	Run the loop where the temperature is read periodically and new cooling 
-//	settings are applied when the temperature enters a new range.
+//  void sleepMs( int ms )
+//	Sleep for ms milliseconds, also when interrupted by a signal.
 //------------------------------------------------------------------------------
-int runControlLoop()
+void sleepMs( int ms )
 {
-    int returnValue = 0;
-    enum TempRange oldRange = 	TempAbove53; // Max cooling by default
+    struct timespec remaining = { ms / 1000, (ms % 1000) * 1000000L };
 
-    while ( true )
+    while ( nanosleep( &remaining, &remaining ) != 0 && errno == EINTR )
     {
-	returnValue = updateTemperature();
-        showProperties();
+    }
+}
+
 
-	if ( !returnValue )
+//------------------------------------------------------------------------------
+//  int simulate()
+//	Run the controller on the samples of the trace gpTracePath, with the
+//	time of the trace, and print statistics of the result on stdout.
+//	The history for the prediction is filled at HISTORY_PERIOD_MS, as in
+//	the control loop, whatever the period of the trace. The display is
+//	only drawn if the transfers are recorded.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int simulate()
+{
+    const char*	pRecordPath = (gpBackend == &gI2cBackendMock) ? gpBusPath
+								 : NULL;
+    long long	nextDisplayMs = 0;
+    long long	nextHistoryMs = 0;
+    bool	bFirst = true;
+    double	startS = 0.0;
+    double	lastS = 0.0;
+    Trace	trace;
+    TraceSample	sample;
+    TraceSample	previous;
+    SimStats	stats;
+    int		result;
+
+    policyDefault( &gPolicy );
+    if ( (gpConfigPath != NULL && policyLoad( &gPolicy, gpConfigPath ) != 0) ||
+	 historyInit( &gHistory, HISTORY_CAPACITY ) != 0 ||
+	 traceOpen( &trace, gpTracePath ) != 0 )
+    {
+	return -1;
+    }
+    initPid();
+
+    if ( i2cBusOpen( &gBus, &gI2cBackendMock, pRecordPath ) != 0 )
+    {
+	traceClose( &trace );
+	return -1;
+    }
+    i2cBusSetClock( &gBus, simulatedClockUs );
+    hatOpen( &gHat, &gBus, COOLINGHAT_I2C_ADDRESS );
+    if ( pRecordPath != NULL )
+    {
+	ssd1306_init( &gDisplay, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT );
+	ssd1306_setBus( &gDisplay, &gBus );
+	ssd1306_begin( &gDisplay, SSD1306_SWITCHCAPVCC, SSD1306_I2C_ADDRESS );
+    }
+
+    simStatsInit( &stats );
+    while ( (result = traceNext( &trace, &sample )) == 1 )
+    {
+	long long	nowMs;
+
+	if ( bFirst )
 	{
-	    enum TempRange tempRange = temperatureRange( gTemperature );
-
-	    if ( tempRange != oldRange )
-	    {
-	        // Set controls for new temperature range
-	        returnValue = setTempControls( tempRange, false );
-	        oldRange = tempRange;
-	    }
-        }
- 
-	// check again in five seconds
-	delay( 5000 );
+	    startS = lastS = sample.timeS;
+	    previous = sample;
+	    bFirst = false;
+	}
+	if ( sample.timeS < lastS )
+	{
+	    fprintf( stderr, "%s: time goes back at %.3f s\n", gpTracePath,
+		     sample.timeS );
+	    result = -1;
+	    break;
+	}
+
+	// The settings of the previous sample held until now
+	if ( gFanState.band >= 0 )
+	{
+	    simStatsAdd( &stats, gFanState.band, gHat.cache[ HAT_REG_FAN ],
+			 sample.timeS - lastS );
+	}
+	lastS = sample.timeS;
+
+	nowMs = (long long)((sample.timeS - startS) * 1000.0);
+	gSimulatedUs = nowMs * 1000;
+	gTemperature = sample.temperature;
+	gCpuStat.busy[ 0 ] = sample.cpuBusy;
+	gCpuStat.bValid = true;
+
+	simulateHistory( &previous, &sample, startS, &nextHistoryMs );
+	previous = sample;
+
+	controlStep( nowMs );
+
+	if ( pRecordPath != NULL && nowMs >= nextDisplayMs )
+	{
+	    showProperties();
+	    nextDisplayMs = nowMs + gDisplayPeriodMs;
+	}
+    }
+    if ( gFanState.band >= 0 )
+    {
+	simStatsAdd( &stats, gFanState.band, gHat.cache[ HAT_REG_FAN ], 0.0 );
+    }
+
+    if ( result == 0 )
+    {
+	simStatsPrint( &stats, &gPolicy, stdout );
+	printf( "I2C:               %lu transfers, %lu bytes\n",
+		gBus.nTransfers, gBus.nBytes );
+    }
+
+    hatClose( &gHat );
+    i2cBusClose( &gBus );
+    traceClose( &trace );
+    historyClose( &gHistory );
+    return result == 0 ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  void simulateHistory( const TraceSample* pPrevious,
+//			  const TraceSample* pSample, double startS,
+//			  long long* pNextMs )
+//	Append the history records of the simulated times *pNextMs up to
+//	pSample, every HISTORY_PERIOD_MS since trace time startS, and advance
+//	*pNextMs. Between trace samples the temperature and CPU utilization
+//	are interpolated from pPrevious, so the slope of the prediction does
+//	not depend on the period of the trace.
+//------------------------------------------------------------------------------
+void simulateHistory( const TraceSample* pPrevious, const TraceSample* pSample,
+		      double startS, long long* pNextMs )
+{
+    double spanS = pSample->timeS - pPrevious->timeS;
+
+    while ( startS + *pNextMs / 1000.0 <= pSample->timeS )
+    {
+	HistoryRecord	record;
+	double		timeS = startS + *pNextMs / 1000.0;
+	double		f = (spanS > 0.0) ? (timeS - pPrevious->timeS) / spanS
+					  : 1.0;
+
+	fillRecord( &record );
+	record.time = (uint32_t)timeS;
+	record.temperature = historyTemperature(
+	    pPrevious->temperature +
+	    f * (pSample->temperature - pPrevious->temperature) );
+	record.cpuLoad = (uint8_t)(pPrevious->cpuBusy +
+				   f * (pSample->cpuBusy - pPrevious->cpuBusy) +
+				   0.5);
+	historyAppend( &gHistory, &record );
+	*pNextMs += HISTORY_PERIOD_MS;
     }
-    
-    return returnValue;
 }
 
 
 //------------------------------------------------------------------------------
-//  void SetRGB( int num, int R, int G, int B)
-//    Sets the R, G and B values of the addressed LEDs
-//    If the maximum amount of leds is addressed, all leds are controlled,
-//    otherwise a specific led van be set.
+//  long long simulatedClockUs()
+//	Returns the simulated time in microseconds, for the I2C record
 //------------------------------------------------------------------------------
-void setRGB( int fd, int num, int R, int G, int B )
+long long simulatedClockUs()
 {
-    if (num >= MAX_LED)
+    return gSimulatedUs;
+}
+
+
+//------------------------------------------------------------------------------
+//  void onSampleTimer( void* pArg )
+//	Scheduler task: read the temperature and apply new cooling settings when
+//	the temperature entered a new range, subject to hysteresis and dwell time.
+//------------------------------------------------------------------------------
+void onSampleTimer( void* pArg )
+{
+    long long	startUs = schedNowUs();
+    int		band = gFanState.band;
+
+    (void) pArg;
+
+    if ( gLastSampleUs != 0 )
+    {
+	long long lateUs = startUs - gLastSampleUs - gSamplePeriodMs * 1000LL;
+
+	exporterObserve( &gSampleLateness, lateUs > 0 ? lateUs / 1e6 : 0.0 );
+    }
+    gLastSampleUs = startUs;
+
+    if ( updateTemperature() != 0 )
     {
-        wiringPiI2CWriteReg8( fd, 0x00, 0xff );
-        wiringPiI2CWriteReg8( fd, 0x01, R );
-        wiringPiI2CWriteReg8( fd, 0x02, G );
-        wiringPiI2CWriteReg8( fd, 0x03, B );
+	return;
     }
-    else if (num >= 0)
+    cpuStatSample( &gCpuStat );
+
+    controlStep( schedNowMs() );
+
+    if ( gFanState.band != band )
     {
-        wiringPiI2CWriteReg8( fd, 0x00, num );
-        wiringPiI2CWriteReg8( fd, 0x01, R );
-        wiringPiI2CWriteReg8( fd, 0x02, G );
-        wiringPiI2CWriteReg8( fd, 0x03, B );
+	gBandChanges++;
+    }
+    exporterObserve( &gSampleDuration, (schedNowUs() - startUs) / 1e6 );
+
+    if ( gExporter.bStarted )
+    {
+	fillExporterSnapshot( exporterSnapshot( &gExporter ));
+	exporterPublish( &gExporter );
     }
 }
 
 
 //------------------------------------------------------------------------------
-//  void closeRGB( int fd )
-//    close the I2C file used for LED control
+//  void controlStep( long long nowMs )
+//	Decide on the cooling for gTemperature at monotonic time nowMs, and
+//	apply new settings: a new range, subject to hysteresis and dwell time,
+//	or the new fan speed of the PID controller.
 //------------------------------------------------------------------------------
-void closeRGB( int fd_i2c )
+void controlStep( long long nowMs )
 {
-//    wiringPiI2CWriteReg8( fd_i2c, 0x07, 0x00 );
-    close( fd_i2c );
-    delay(100);
+    double predicted;
+
+    if ( gControlMode == ControlPid )
+    {
+	// The PID mode selects the led color for the actual temperature
+	gPredictedTemperature = gTemperature;
+	runPid( nowMs );
+	return;
+    }
+
+    // Also while boosted, so the exported prediction stays current
+    predicted = predictTemperature();
+    if ( policyUpdate( &gPolicy, &gFanState,
+		       throttleBoost() ?
+		       gPolicy.bands[ gPolicy.nBands - 1 ].lower : predicted,
+		       nowMs ))
+    {
+	// Set controls for new temperature range
+	setTempControls( gFanState.band, false );
+    }
 }
 
 
 //------------------------------------------------------------------------------
-//  int showProperties()
-//	Retrieves system properties and displays them on the OLED display that
-//	is mounted on the Smart Cooling Hat.
-//	Returns 0 if all properties were displayed successfully; -1 otherwise
+//  double predictTemperature()
+//	Predict the temperature from its recent slope and the rise of the CPU
+//	utilization in the history, if gPolicy configures a prediction, and
+//	keep it in gPredictedTemperature.
+//	Returns the temperature to select the range for
 //------------------------------------------------------------------------------
-int showProperties()
+double predictTemperature()
 {
-    struct sysinfo 	sysInfo;
-    struct statfs 	diskInfo;
-    struct ifaddrs*	pIfAddrStruct = NULL;
-    void*               pTmpAddr = NULL;
-    char 		cpuInfoTxt	[MAX_SIZE];
-    char		cpuTempTxt	[MAX_SIZE];
-    char 		ramInfoTxt	[MAX_SIZE];
-    char		ipInfoTxt 	[MAX_SIZE];
-    char		diskInfoTxt	[MAX_SIZE];
-    char 		addressBuffer	[INET_ADDRSTRLEN];
-    bool		bResult = true;
- 
-    // Initialize oled display:
-    ssd1306_begin( SSD1306_SWITCHCAPVCC, SSD1306_I2C_ADDRESS );
-    ssd1306_clearDisplay();
-
-    // Retrieve system info
-    if( sysinfo( &sysInfo ) != 0 )
-    {
-	char *text = "sysinfo-Error";
-	ssd1306_drawString(text);
-	ssd1306_display();
-        bResult = false;
-    }
-
-    // Fill cpuInfoTxt and cpuTempTxt buffers:
-    unsigned long avgCpuLoad = sysInfo.loads[0] / 1000;
-    sprintf( cpuInfoTxt, "CPU:%ld%%", avgCpuLoad);
-    sprintf(cpuTempTxt, "Temp:%.1fC", gTemperature);	
-
-    // Fill ramInfoTxt buffer:
-    unsigned long totalRam = sysInfo.totalram >> 20;
-    unsigned long freeRam =  sysInfo.freeram >> 20;
-    sprintf(ramInfoTxt, "RAM:%ld/%ld MB", freeRam, totalRam);
-
-    // Fill ipInfo buffer:
-    // Look for interface with name "eth0" or "wlan0":
-    getifaddrs( &pIfAddrStruct );
-
-    while ( pIfAddrStruct != NULL )
-    {
-	if ( pIfAddrStruct->ifa_addr->sa_family == AF_INET ) 
-	{ 
-           // check it is IP4 is a valid IP4 Address
-	    struct sockaddr_in* pSockAddress = 
-		((struct sockaddr_in *)pIfAddrStruct->ifa_addr );            
-	    pTmpAddr = &pSockAddress->sin_addr;
-
-	    inet_ntop( AF_INET, pTmpAddr, addressBuffer, INET_ADDRSTRLEN );
-
-	    if ( strcmp( pIfAddrStruct->ifa_name, "eth0" ) == 0 )
-	    {
-		sprintf( ipInfoTxt, "eth0:IP:%s", addressBuffer );
-		break;
-	    }
-	    else if ( strcmp( pIfAddrStruct->ifa_name, "wlan0" ) == 0 )
-	    {
-		sprintf( ipInfoTxt, "wlan0:%s", addressBuffer );
-		break;
-	    }
+    HistoryRecord	records	[ POLICY_PREDICT_MAX_SAMPLES ];
+    int			nRecords = 0;
+
+    if ( gPolicy.predictHorizonS > 0.0 )
+    {
+	nRecords = historyLatest( &gHistory, records, gPolicy.predictSamples );
+    }
+    gPredictedTemperature = policyPredict( &gPolicy, records, nRecords,
+					   HISTORY_PERIOD_MS / 1000.0,
+					   gTemperature,
+					   gCpuStat.bValid ? gCpuStat.busy[ 0 ]
+							   : 0.0 );
+    return gPredictedTemperature;
+}
+
+
+//------------------------------------------------------------------------------
+//  bool throttleBoost()
+//	Returns whether cooling has to be at its maximum because -T was given
+//	and the firmware throttles the ARM clock or holds it at the soft
+//	temperature limit
+//------------------------------------------------------------------------------
+bool throttleBoost()
+{
+    return gbThrottleBoost && gThrottle.bValid &&
+	   (gThrottle.flags & (THROTTLE_THROTTLED | THROTTLE_SOFT_TEMP)) != 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void initPid()
+//	(Re)start the PID controller with the gains of gPolicy and the setpoint
+//	of the command line or else of gPolicy.
+//------------------------------------------------------------------------------
+void initPid()
+{
+    double setpoint = (gSetpoint >= 0.0) ? gSetpoint : gPolicy.setpoint;
+
+    pidInit( &gPid, setpoint, gPolicy.kp, gPolicy.ki, gPolicy.kd );
+    gFanValue = -1;
+    gLedRange = -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  void runPid( long long nowMs )
+//	Feed gTemperature at time nowMs to the PID controller and write the
+//	fan register when its quantized output changes. The led color follows
+//	the temperature range, subject to the same hysteresis as in step mode.
+//------------------------------------------------------------------------------
+void runPid( long long nowMs )
+{
+    double	duty = pidUpdate( &gPid, gTemperature, nowMs );
+    int		fanValue = pidFanValue( duty, gFanValue < 0 ? 0 : gFanValue );
+
+    if ( throttleBoost() )
+    {
+	fanValue = HAT_FAN_FULL;
+    }
+
+    policyUpdate( &gPolicy, &gFanState, gTemperature, nowMs );
+    if ( fanValue != gFanValue || gFanState.band != gLedRange )
+    {
+	bool bNewColor = (gFanState.band != gLedRange);
+
+	setCoolingHat( fanValue,
+		       bNewColor ? &gPolicy.bands[ gFanState.band ] : NULL );
+	gFanValue = fanValue;
+	gLedRange = gFanState.band;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void onDisplayTimer( void* pArg )
+//	Scheduler task: refresh the OLED display.
+//------------------------------------------------------------------------------
+void onDisplayTimer( void* pArg )
+{
+    (void) pArg;
+
+    if ( !gDisplayWorker.bStarted )
+    {
+	showProperties();
+	return;
+    }
+
+    // Never waits for the display: the worker draws the latest snapshot
+    fillSnapshot( displaySnapshot( &gDisplayWorker ));
+    displayPublish( &gDisplayWorker );
+}
+
+
+//------------------------------------------------------------------------------
+//  void onSlowTimer( void* pArg )
+//	Scheduler task: refresh properties that rarely change. The IP address
+//	is only polled when there are no netlink notifications for it.
+//------------------------------------------------------------------------------
+void onSlowTimer( void* pArg )
+{
+    (void) pArg;
+    metricsRefreshDisk( &gMetrics );
+    if ( gMetrics.netlinkFd < 0 )
+    {
+	metricsRefreshIp( &gMetrics );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void onHistoryTimer( void* pArg )
+//	Scheduler task: append the current temperatures, fan register and CPU
+//	load to gHistory and to the sample log.
+//------------------------------------------------------------------------------
+void onHistoryTimer( void* pArg )
+{
+    HistoryRecord record;
+
+    (void) pArg;
+
+    fillRecord( &record );
+    historyAppend( &gHistory, &record );
+    if ( gpLogPath != NULL )
+    {
+	sampleLogAppend( &gSampleLog, &record );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  void onLogSyncTimer( void* pArg )
+//	Scheduler task: write the samples logged since the previous call to
+//	the card, in one batch of pages.
+//------------------------------------------------------------------------------
+void onLogSyncTimer( void* pArg )
+{
+    (void) pArg;
+    sampleLogSync( &gSampleLog );
+}
+
+
+//------------------------------------------------------------------------------
+//  void onThrottleTimer( void* pArg )
+//	Scheduler task: read the firmware throttle flags and the ARM clock.
+//	The next temperature sample acts on them.
+//------------------------------------------------------------------------------
+void onThrottleTimer( void* pArg )
+{
+    (void) pArg;
+    throttleSample( &gThrottle );
+}
+
+
+//------------------------------------------------------------------------------
+//  void onWatchdogTimer( void* pArg )
+//	Scheduler task: tell systemd the control loop is alive. It runs in the
+//	same thread as the temperature samples, so it stops when a sample
+//	hangs.
+//------------------------------------------------------------------------------
+void onWatchdogTimer( void* pArg )
+{
+    (void) pArg;
+    sdNotify( &gNotify, "WATCHDOG=1" );
+}
+
+
+//------------------------------------------------------------------------------
+//  void onTerminateSignal( void* pArg )
+//	Scheduler task for SIGTERM and SIGINT: end the control loop of
+//	scheduler pArg.
+//------------------------------------------------------------------------------
+void onTerminateSignal( void* pArg )
+{
+    fprintf( stderr, "Terminating, fan at full speed\n" );
+    schedStop( (Scheduler*)pArg );
+}
+
+
+//------------------------------------------------------------------------------
+//  int setFanFull()
+//	Switch the fan to full speed and exit; for ExecStopPost of the service,
+//	so the fan is safe whichever way the control loop ended.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+int setFanFull()
+{
+    int result = -1;
+
+    if ( i2cBusOpen( &gBus, gpBackend, gpBusPath ) == 0 &&
+	 hatOpen( &gHat, &gBus, COOLINGHAT_I2C_ADDRESS ) == 0 )
+    {
+	result = hatSetFan( &gHat, HAT_FAN_FULL );
+    }
+    if ( result != 0 )
+    {
+	fprintf( stderr, "Could not set the fan\n" );
+    }
+    hatClose( &gHat );
+    i2cBusClose( &gBus );
+    return result;
+}
+
+
+//------------------------------------------------------------------------------
+//  void fillRecord( HistoryRecord* pRecord )
+//	Fill a history record with the current temperatures, fan register and
+//	CPU utilization.
+//------------------------------------------------------------------------------
+void fillRecord( HistoryRecord* pRecord )
+{
+    int			fanValue = gHat.cache[ HAT_REG_FAN ];
+    int			i;
+
+    pRecord->time = (uint32_t)time( NULL );
+    pRecord->temperature = historyTemperature( gTemperature );
+    for ( i = 0; i < HISTORY_ZONES; i++ )
+    {
+	pRecord->zones[ i ] =
+	    (i < gThermal.nZones && gThermal.zones[ i ].bValid) ?
+	    historyTemperature( gThermal.zones[ i ].temperature ) :
+	    HISTORY_NO_VALUE;
+    }
+    pRecord->fanValue = (fanValue < 0) ? 0xff : (uint8_t)fanValue;
+
+    pRecord->cpuLoad = gCpuStat.bValid ? (uint8_t)(gCpuStat.busy[ 0 ] + 0.5) : 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void onReloadSignal( void* pArg )
+//	Scheduler task for SIGHUP: read the config file again. The new table
+//	is applied on the next temperature sample; the old table is kept if the
+//	file is invalid.
+//------------------------------------------------------------------------------
+void onReloadSignal( void* pArg )
+{
+    (void) pArg;
+
+    if ( gpConfigPath == NULL )
+    {
+	fprintf( stderr, "SIGHUP ignored: no config file\n" );
+	return;
+    }
+
+    if ( policyLoad( &gPolicy, gpConfigPath ) == 0 )
+    {
+	fprintf( stderr, "Reloaded %s, %d ranges\n", gpConfigPath,
+		 gPolicy.nBands );
+	policyResetState( &gFanState );	// apply the settings again
+	initPid();
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  runControlLoop()
+//	Run the loop where the temperature is read periodically and new cooling 
+//	settings are applied when the temperature enters a new range. The
+//	display and the slow properties are refreshed at their own rates, and
+//	SIGHUP reloads the config file. The display is drawn and transferred
+//	by a worker thread, so the display never delays a fan decision.
+//	Under systemd, readiness is notified once the loop runs and the
+//	watchdog is pinged from the loop, so a hung transfer gets the service
+//	restarted. SIGTERM and SIGINT end the loop; the fan is then left at
+//	full speed.
+//	Returns 0 after SIGTERM or SIGINT, -1 if the scheduler could not be
+//	set up or failed.
+//------------------------------------------------------------------------------
+int runControlLoop()
+{
+    Scheduler	sched;
+    long long	watchdogUs = sdWatchdogUs();
+    int		watchdogMs = (int)(watchdogUs / 2000);	// half the interval
+    int 	returnValue = -1;
+
+    if ( schedInit( &sched ) != 0 )
+    {
+	return -1;
+    }
+    sdNotifyInit( &gNotify );
+
+    if ( schedAddTimer( &sched, gSamplePeriodMs, onSampleTimer, NULL ) >= 0 &&
+	 schedAddTimer( &sched, gDisplayPeriodMs, onDisplayTimer, NULL ) >= 0 &&
+	 schedAddTimer( &sched, gSlowPeriodS * 1000, onSlowTimer, NULL ) >= 0 &&
+	 schedAddTimer( &sched, HISTORY_PERIOD_MS, onHistoryTimer, NULL ) >= 0 &&
+	 (gThrottle.vcioFd < 0 ||
+	  schedAddTimer( &sched, THROTTLE_PERIOD_MS, onThrottleTimer,
+			 NULL ) >= 0 ) &&
+	 (gpLogPath == NULL ||
+	  schedAddTimer( &sched, SAMPLELOG_SYNC_S * 1000, onLogSyncTimer,
+			 NULL ) >= 0 ) &&
+	 (watchdogUs == 0 ||
+	  schedAddTimer( &sched, watchdogMs > 0 ? watchdogMs : 1,
+			 onWatchdogTimer, NULL ) >= 0 ) &&
+	 schedAddSignal( &sched, SIGHUP, onReloadSignal, NULL ) == 0 &&
+	 schedAddSignal( &sched, SIGTERM, onTerminateSignal, &sched ) == 0 &&
+	 schedAddSignal( &sched, SIGINT, onTerminateSignal, &sched ) == 0 &&
+	 (gMetrics.netlinkFd < 0 ||
+	  schedAddFd( &sched, gMetrics.netlinkFd, metricsOnNetlink,
+		      &gMetrics ) == 0 ))
+    {
+	// Apply the cooling for the temperature right away, instead of one
+	// sample period after startup
+	onSampleTimer( NULL );
+
+	// Started after the signals are blocked, so the workers inherit that
+	if ( displayStart( &gDisplayWorker, &gDisplay, &gHistory ) != 0 )
+	{
+	    fprintf( stderr, "Display is drawn in the control loop\n" );
+	}
+	if ( gExporterPort != 0 && exporterStart( &gExporter, gExporterPort ) != 0 )
+	{
+	    fprintf( stderr, "Metrics are not exported\n" );
 	}
-	pIfAddrStruct = pIfAddrStruct->ifa_next;
+	sdNotify( &gNotify, "READY=1" );
+	returnValue = schedRun( &sched );
+	sdNotify( &gNotify, "STOPPING=1" );
+	exporterStop( &gExporter );
+	displayStop( &gDisplayWorker );
     }
 
-    // Fill diskInfoTxt buffer:
-    statfs("/", &diskInfo);
-    unsigned long long totalBlocks = 	diskInfo.f_bsize;
-    unsigned long long totalSize = 	totalBlocks * diskInfo.f_blocks;
-    size_t 				mbTotalsize = totalSize >> 20;
-    unsigned long long freeDisk = 	diskInfo.f_bfree * totalBlocks;
-    size_t 				mbFreedisk = freeDisk >> 20;
-    sprintf( diskInfoTxt, "Disk:%ld/%ldMB", mbFreedisk, mbTotalsize);
+    // Nothing controls the fan after this: leave it at full speed
+    hatSetFan( &gHat, HAT_FAN_FULL );
 
-    // Write the buffers to the oled display:
-    ssd1306_drawText(0,  0, cpuInfoTxt );
-    ssd1306_drawText(56, 0, cpuTempTxt );
-    ssd1306_drawText(0,  8, ramInfoTxt );
-    ssd1306_drawText(0, 16, diskInfoTxt );
-    ssd1306_drawText(0, 24, ipInfoTxt );
-    ssd1306_display();
-  
-    return 0;    
+    sdNotifyClose( &gNotify );
+    schedClose( &sched );
+    return returnValue;
 }
 
+
+//------------------------------------------------------------------------------
+//  void fillSnapshot( DisplaySnapshot* pSnapshot )
+//	Copy the properties of the control loop that are displayed.
+//------------------------------------------------------------------------------
+void fillSnapshot( DisplaySnapshot* pSnapshot )
+{
+    pSnapshot->temperature = gTemperature;
+    pSnapshot->cpuBusy = gCpuStat.bValid ? gCpuStat.busy[ 0 ] : 0.0;
+    pSnapshot->bThrottled = throttleActive( &gThrottle );
+    memcpy( pSnapshot->diskInfoTxt, gMetrics.diskInfoTxt,
+	    sizeof( pSnapshot->diskInfoTxt ));
+    memcpy( pSnapshot->ipInfoTxt, gMetrics.ipInfoTxt,
+	    sizeof( pSnapshot->ipInfoTxt ));
+    pSnapshot->bandChanges = gBandChanges;
+    pSnapshot->dimFromHour = gPolicy.dimFromHour;
+    pSnapshot->dimToHour = gPolicy.dimToHour;
+    pSnapshot->blankMs = gPolicy.blankMs;
+}
+
+
+//------------------------------------------------------------------------------
+//  void fillExporterSnapshot( ExporterSnapshot* pSnapshot )
+//	Copy the state of the control loop that is exported.
+//------------------------------------------------------------------------------
+void fillExporterSnapshot( ExporterSnapshot* pSnapshot )
+{
+    int i;
+
+    pSnapshot->temperature = gTemperature;
+    pSnapshot->predictedTemperature = gPredictedTemperature;
+    pSnapshot->nZones = gThermal.nZones;
+    for ( i = 0; i < gThermal.nZones; i++ )
+    {
+	memcpy( pSnapshot->zoneNames[ i ], gThermal.zones[ i ].name,
+		sizeof( pSnapshot->zoneNames[ i ] ));
+	pSnapshot->zoneTemperatures[ i ] = gThermal.zones[ i ].temperature;
+	pSnapshot->zoneValid[ i ] = gThermal.zones[ i ].bValid;
+    }
+    pSnapshot->nCpus = gCpuStat.bValid ? gCpuStat.nCpus : -1;
+    memcpy( pSnapshot->cpuBusy, gCpuStat.busy, sizeof( pSnapshot->cpuBusy ));
+    pSnapshot->bThrottleValid = gThrottle.bValid;
+    pSnapshot->throttleFlags = gThrottle.flags;
+    memcpy( pSnapshot->throttleCounts, gThrottle.counts,
+	    sizeof( pSnapshot->throttleCounts ));
+    pSnapshot->armFreqKHz = gThrottle.freqKHz;
+    pSnapshot->fanValue = gHat.cache[ HAT_REG_FAN ];
+    pSnapshot->band = gFanState.band;
+    pSnapshot->bandChanges = gBandChanges;
+    pSnapshot->hatTransfers = gHat.nTransfers;
+    i2cBusCounters( &gBus, &pSnapshot->i2cTransfers, &pSnapshot->i2cErrors );
+    pSnapshot->sampleDuration = gSampleDuration;
+    pSnapshot->sampleLateness = gSampleLateness;
+}
+
+
+//------------------------------------------------------------------------------
+//  int showProperties()
+//	Retrieves system properties and displays them on the OLED display that
+//	is mounted on the Smart Cooling Hat, in the calling thread.
+//	Returns 0 if all properties were displayed successfully; -1 otherwise
+//------------------------------------------------------------------------------
+int showProperties()
+{
+    DisplaySnapshot snapshot;
+
+    fillSnapshot( &snapshot );
+    return displayRender( &gDisplay, &gDisplayText, &snapshot );
+}
@@ -0,0 +1,408 @@
+//------------------------------------------------------------------------------
+//  File: 	thermal.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Multi-zone temperature sampling, see thermal.h.
+//
+//  Sensors are taken from:
+//	/sys/class/thermal/thermal_zone<N>/temp	named after the zone "type"
+//	/sys/class/hwmon/hwmon<N>/temp<K>_input	named "<hwmon name>/temp<K>"
+//  The thermal framework also exposes its zones as hwmon devices; those
+//  duplicates are skipped.
+//
+//------------------------------------------------------------------------------
+#define _GNU_SOURCE		// versionsort()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "thermal.h"
+
+#ifndef THERMAL_SYSFS_ROOT
+#define THERMAL_SYSFS_ROOT	"/sys/class"
+#endif
+
+#define THERMAL_MAX_HWMON_INPUTS	16
+
+
+//------------------------------------------------------------------------------
+//  static void readName( const char* pPath, char* pName )
+//	Read the first line of pPath into pName (THERMAL_NAME_SIZE bytes).
+//	pName is left unchanged if the file cannot be read.
+//------------------------------------------------------------------------------
+static void readName( const char* pPath, char* pName )
+{
+    char	buf[ THERMAL_NAME_SIZE ];
+    int		fd = open( pPath, O_RDONLY | O_CLOEXEC );
+    ssize_t	len;
+
+    if ( fd < 0 )
+    {
+	return;
+    }
+
+    len = read( fd, buf, sizeof( buf ) - 1 );
+    close( fd );
+    if ( len > 0 )
+    {
+	buf[ len ] = '\0';
+	buf[ strcspn( buf, "\n" ) ] = '\0';
+	snprintf( pName, THERMAL_NAME_SIZE, "%s", buf );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool addZone( Thermal* pThermal, const char* pPath,
+//			 const char* pName )
+//	Open the temperature input pPath and add it as a zone.
+//	Returns true if the zone was added
+//------------------------------------------------------------------------------
+static bool addZone( Thermal* pThermal, const char* pPath, const char* pName )
+{
+    ThermalZone*	pZone;
+    int 		fd;
+
+    if ( pThermal->nZones >= THERMAL_MAX_ZONES )
+    {
+	return false;
+    }
+
+    fd = open( pPath, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+	return false;
+    }
+
+    pZone = &pThermal->zones[ pThermal->nZones++ ];
+    pZone->fd = fd;
+    pZone->weight = 1.0;
+    pZone->bValid = false;
+    pZone->temperature = 0.0;
+    snprintf( pZone->name, THERMAL_NAME_SIZE, "%s", pName );
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//  static bool isThermalZoneName( Thermal* pThermal, const char* pName )
+//	Hwmon devices registered by the thermal framework are named after the
+//	zone type with '-' replaced by '_'. Returns true if pName is such a name.
+//------------------------------------------------------------------------------
+static bool isThermalZoneName( Thermal* pThermal, const char* pName )
+{
+    int i;
+
+    for ( i = 0; i < pThermal->nZones; i++ )
+    {
+	const char* a = pThermal->zones[ i ].name;
+	const char* b = pName;
+
+	while ( *a && (*a == *b || (*a == '-' && *b == '_')) )
+	{
+	    a++;
+	    b++;
+	}
+	if ( *a == '\0' && *b == '\0' )
+	{
+	    return true;
+	}
+    }
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+//  static void discover( Thermal* pThermal, const char* pClass,
+//			  const char* pPrefix, bool bHwmon )
+//	Add the sensors of all devices in THERMAL_SYSFS_ROOT/pClass whose name
+//	starts with pPrefix, in name order.
+//------------------------------------------------------------------------------
+static void discover( Thermal* pThermal, const char* pClass,
+		      const char* pPrefix, bool bHwmon )
+{
+    struct dirent**	pEntries;
+    char		dir	[ 128 ];
+    char		path	[ 512 ];
+    char		name	[ THERMAL_NAME_SIZE ];
+    int 		nEntries;
+    int 		i, k;
+
+    snprintf( dir, sizeof( dir ), "%s/%s", THERMAL_SYSFS_ROOT, pClass );
+    nEntries = scandir( dir, &pEntries, NULL, versionsort );
+    if ( nEntries < 0 )
+    {
+	return;
+    }
+
+    for ( i = 0; i < nEntries; i++ )
+    {
+	const char* pEntry = pEntries[ i ]->d_name;
+
+	if ( strncmp( pEntry, pPrefix, strlen( pPrefix )) != 0 )
+	{
+	    continue;
+	}
+
+	if ( !bHwmon )
+	{
+	    snprintf( name, sizeof( name ), "%.31s", pEntry );
+	    snprintf( path, sizeof( path ), "%s/%s/type", dir, pEntry );
+	    readName( path, name );
+	    snprintf( path, sizeof( path ), "%s/%s/temp", dir, pEntry );
+	    addZone( pThermal, path, name );
+	    continue;
+	}
+
+	char hwmonName[ THERMAL_NAME_SIZE ];
+
+	snprintf( hwmonName, sizeof( hwmonName ), "%.31s", pEntry );
+	snprintf( path, sizeof( path ), "%s/%s/name", dir, pEntry );
+	readName( path, hwmonName );
+	if ( isThermalZoneName( pThermal, hwmonName ))
+	{
+	    continue;
+	}
+
+	for ( k = 1; k <= THERMAL_MAX_HWMON_INPUTS; k++ )
+	{
+	    snprintf( path, sizeof( path ), "%s/%s/temp%d_input", dir, pEntry,
+		      k );
+	    snprintf( name, sizeof( name ), "%.*s/temp%d",
+		      THERMAL_NAME_SIZE - 8, hwmonName, k );
+	    addZone( pThermal, path, name );
+	}
+    }
+
+    for ( i = 0; i < nEntries; i++ )
+    {
+	free( pEntries[ i ] );
+    }
+    free( pEntries );
+}
+
+
+//------------------------------------------------------------------------------
+//  int thermalInit( Thermal* pThermal )
+//	Discover and open all temperature sensors. The zones are combined with
+//	ThermalMax until thermalSetWeights is called.
+//	Returns 0 if at least one sensor was found, -1 otherwise
+//------------------------------------------------------------------------------
+int thermalInit( Thermal* pThermal )
+{
+    int i;
+
+    memset( pThermal, 0, sizeof( *pThermal ));
+    pThermal->mode = ThermalMax;
+
+    discover( pThermal, "thermal", "thermal_zone", false );
+    discover( pThermal, "hwmon", "hwmon", true );
+
+    for ( i = 0; i < pThermal->nZones; i++ )
+    {
+	fprintf( stderr, "Temperature zone %d: %s\n", i,
+		 pThermal->zones[ i ].name );
+    }
+    return pThermal->nZones > 0 ? 0 : -1;
+}
+
+
+//------------------------------------------------------------------------------
+//  int thermalSetWeights( Thermal* pThermal, const char* pSpec )
+//	Select how the zones are combined. pSpec is either "max" or a comma
+//	separated list of <zone name>=<weight>; in the latter case the control
+//	temperature is the weighted average of the listed zones, and zones
+//	that are not listed do not count.
+//	Returns 0 on success, -1 if pSpec is invalid
+//------------------------------------------------------------------------------
+int thermalSetWeights( Thermal* pThermal, const char* pSpec )
+{
+    char	spec	[ 256 ];
+    char*	pSave = NULL;
+    char*	pItem;
+    double	total = 0.0;
+    int 	i;
+
+    if ( strcmp( pSpec, "max" ) == 0 )
+    {
+	pThermal->mode = ThermalMax;
+	return 0;
+    }
+
+    for ( i = 0; i < pThermal->nZones; i++ )
+    {
+	pThermal->zones[ i ].weight = 0.0;
+    }
+
+    snprintf( spec, sizeof( spec ), "%s", pSpec );
+    for ( pItem = strtok_r( spec, ",", &pSave ); pItem != NULL;
+	  pItem = strtok_r( NULL, ",", &pSave ))
+    {
+	char* pWeight = strrchr( pItem, '=' );
+	char* pEnd;
+
+	if ( pWeight == NULL )
+	{
+	    fprintf( stderr, "Missing weight in '%s'\n", pItem );
+	    return -1;
+	}
+	*pWeight++ = '\0';
+
+	for ( i = 0; i < pThermal->nZones; i++ )
+	{
+	    if ( strcmp( pThermal->zones[ i ].name, pItem ) == 0 )
+	    {
+		break;
+	    }
+	}
+	double weight = strtod( pWeight, &pEnd );
+	if ( i == pThermal->nZones || *pEnd != '\0' || weight < 0.0 )
+	{
+	    fprintf( stderr, "Invalid zone weight '%s=%s'\n", pItem, pWeight );
+	    return -1;
+	}
+	pThermal->zones[ i ].weight = weight;
+	total += weight;
+    }
+
+    if ( total <= 0.0 )
+    {
+	fprintf( stderr, "No zone has a weight\n" );
+	return -1;
+    }
+    pThermal->mode = ThermalWeighted;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int thermalSample( Thermal* pThermal )
+//	Read all zones, one pread() each issued back to back, and combine them
+//	into pThermal->temperature. Zones that cannot be read are left out.
+//	Returns 0 on success, -1 if no zone that counts could be read; the
+//	combined temperature is left unchanged in that case.
+//------------------------------------------------------------------------------
+int thermalSample( Thermal* pThermal )
+{
+    char	buf	[ 32 ];
+    double	sum = 0.0;
+    double	weights = 0.0;
+    double	hottest = 0.0;
+    bool	bAny = false;
+    int		i;
+
+    for ( i = 0; i < pThermal->nZones; i++ )
+    {
+	ThermalZone*	pZone = &pThermal->zones[ i ];
+	long		milliDegrees;
+	ssize_t		len = pread( pZone->fd, buf, sizeof( buf ), 0 );
+
+	pZone->bValid = len > 0 &&
+		thermalParseMilliDegrees( buf, len, &milliDegrees ) == 0;
+	if ( pZone->bValid )
+	{
+	    pZone->temperature = milliDegrees / 1000.0;
+	}
+    }
+
+    for ( i = 0; i < pThermal->nZones; i++ )
+    {
+	ThermalZone* pZone = &pThermal->zones[ i ];
+
+	if ( !pZone->bValid )
+	{
+	    continue;
+	}
+
+	if ( pThermal->mode == ThermalMax )
+	{
+	    if ( !bAny || pZone->temperature > hottest )
+	    {
+		hottest = pZone->temperature;
+	    }
+	    bAny = true;
+	}
+	else if ( pZone->weight > 0.0 )
+	{
+	    sum += pZone->weight * pZone->temperature;
+	    weights += pZone->weight;
+	    bAny = true;
+	}
+    }
+
+    if ( !bAny )
+    {
+	return -1;
+    }
+
+    pThermal->temperature =
+	(pThermal->mode == ThermalMax) ? hottest : sum / weights;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void thermalClose( Thermal* pThermal )
+//	Close the sensor fds.
+//------------------------------------------------------------------------------
+void thermalClose( Thermal* pThermal )
+{
+    int i;
+
+    for ( i = 0; i < pThermal->nZones; i++ )
+    {
+	close( pThermal->zones[ i ].fd );
+    }
+    pThermal->nZones = 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int thermalParseMilliDegrees( const char* buf, int len, long* pValue )
+//	Parse the first len characters of buf, which hold a temperature in
+//	millidegrees as written by the thermal driver: an optional minus sign
+//	and decimal digits, optionally followed by a newline. buf does not
+//	need to be NUL-terminated.
+//	Returns 0 and the value in *pValue on success, -1 otherwise
+//------------------------------------------------------------------------------
+int thermalParseMilliDegrees( const char* buf, int len, long* pValue )
+{
+    bool	bNegative = false;
+    long	value = 0;
+    int		i = 0;
+
+    if ( i < len && buf[ i ] == '-' )
+    {
+	bNegative = true;
+	i++;
+    }
+
+    if ( i >= len || buf[ i ] < '0' || buf[ i ] > '9' )
+    {
+	return -1;
+    }
+
+    while ( i < len && buf[ i ] >= '0' && buf[ i ] <= '9' )
+    {
+	if ( value > 100000000L )
+	{
+	    return -1;	// no sensor reports this; the read was garbage
+	}
+	value = value * 10 + (buf[ i ] - '0');
+	i++;
+    }
+
+    if ( i < len && buf[ i ] != '\n' )
+    {
+	return -1;
+    }
+
+    *pValue = bNegative ? -value : value;
+    return 0;
+}
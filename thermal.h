@@ -0,0 +1,51 @@
+//------------------------------------------------------------------------------
+//  File: 	thermal.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Temperature sampling across all thermal zones and hwmon temperature inputs
+//  of the board. The sensors are discovered once at startup and keep an open
+//  fd each; a sample reads all of them back to back with one pread() per
+//  sensor and combines the readings into a single control temperature.
+//
+//------------------------------------------------------------------------------
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <stdbool.h>
+
+#define THERMAL_MAX_ZONES 	8
+#define THERMAL_NAME_SIZE 	32
+
+// How the zone temperatures are combined into the control temperature
+typedef enum ThermalMode
+{
+    ThermalMax =	0,	// hottest zone
+    ThermalWeighted =	1	// weighted average of the zones
+} ThermalMode;
+
+typedef struct ThermalZone
+{
+    int		fd;
+    char	name	[ THERMAL_NAME_SIZE ];
+    double	weight;		// used in ThermalWeighted mode
+    bool	bValid;		// last sample could be read
+    double	temperature;	// degrees Celsius
+} ThermalZone;
+
+typedef struct Thermal
+{
+    int		nZones;
+    ThermalMode mode;
+    ThermalZone	zones	[ THERMAL_MAX_ZONES ];
+    double	temperature;	// combined temperature of the last sample
+} Thermal;
+
+int	thermalInit( Thermal* pThermal );
+int	thermalSetWeights( Thermal* pThermal, const char* pSpec );
+int	thermalSample( Thermal* pThermal );
+void	thermalClose( Thermal* pThermal );
+int	thermalParseMilliDegrees( const char* buf, int len, long* pValue );
+
+#endif
@@ -0,0 +1,153 @@
+//------------------------------------------------------------------------------
+//  File: 	throttle.c
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Throttle monitor, see throttle.h.
+//
+//  A mailbox property request is a buffer of 32-bit words:
+//	buffer size in bytes, request code 0,
+//	tag, value buffer size, request/response size, value buffer,
+//	end tag 0
+//  The firmware replaces the request code with 0x80000000 on success and
+//  stores the response in the value buffer.
+//
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+
+#include "throttle.h"
+
+#define MBOX_IOCTL_PROPERTY	_IOWR( 100, 0, char* )
+#define MBOX_REQUEST		0x00000000
+#define MBOX_RESPONSE_OK	0x80000000
+#define MBOX_TAG_GET_THROTTLED	0x00030046
+#define MBOX_TAG_END		0x00000000
+
+
+//------------------------------------------------------------------------------
+//  int throttleInit( Throttle* pThrottle )
+//	Open the mailbox and the cpufreq file. Either may be missing, e.g. when
+//	not running on a Pi; their values are then not available.
+//	Returns 0 if the throttle flags can be read, -1 otherwise
+//------------------------------------------------------------------------------
+int throttleInit( Throttle* pThrottle )
+{
+    memset( pThrottle, 0, sizeof( *pThrottle ));
+    pThrottle->vcioFd = open( THROTTLE_VCIO_PATH, O_RDONLY | O_CLOEXEC );
+    pThrottle->freqFd = open( THROTTLE_FREQ_PATH, O_RDONLY | O_CLOEXEC );
+
+    if ( pThrottle->vcioFd < 0 )
+    {
+	fprintf( stderr, "Could not open %s, throttling is not monitored\n",
+		 THROTTLE_VCIO_PATH );
+	return -1;
+    }
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  static int getThrottled( int fd, uint32_t* pFlags )
+//	Make the get_throttled mailbox request.
+//	Returns 0 on success, -1 otherwise
+//------------------------------------------------------------------------------
+static int getThrottled( int fd, uint32_t* pFlags )
+{
+    uint32_t message[ 7 ] __attribute__(( aligned( 16 ))) =
+    {
+	sizeof( message ), MBOX_REQUEST,
+	MBOX_TAG_GET_THROTTLED, 4, 0, 0,
+	MBOX_TAG_END
+    };
+
+    if ( ioctl( fd, MBOX_IOCTL_PROPERTY, message ) < 0 ||
+	 message[ 1 ] != MBOX_RESPONSE_OK )
+    {
+	return -1;
+    }
+    *pFlags = message[ 5 ];
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  int throttleSample( Throttle* pThrottle )
+//	Read the throttle flags and the ARM clock, and count the flags that
+//	became set since the previous sample.
+//	Returns 0 if the flags were read, -1 otherwise
+//------------------------------------------------------------------------------
+int throttleSample( Throttle* pThrottle )
+{
+    uint32_t	flags;
+    int		i;
+
+    if ( pThrottle->freqFd >= 0 )
+    {
+	char	buf	[ 24 ];
+	ssize_t	len = pread( pThrottle->freqFd, buf, sizeof( buf ) - 1, 0 );
+	long	freqKHz = 0;
+
+	for ( i = 0; i < len && buf[ i ] >= '0' && buf[ i ] <= '9'; i++ )
+	{
+	    freqKHz = freqKHz * 10 + (buf[ i ] - '0');
+	}
+	pThrottle->freqKHz = freqKHz;
+    }
+
+    if ( pThrottle->vcioFd < 0 || getThrottled( pThrottle->vcioFd, &flags ) != 0 )
+    {
+	pThrottle->bValid = false;
+	return -1;
+    }
+
+    for ( i = 0; i < THROTTLE_NUM_FLAGS; i++ )
+    {
+	uint32_t flag = 1u << i;
+
+	if ( (flags & flag) && !(pThrottle->bValid && (pThrottle->flags & flag)) )
+	{
+	    pThrottle->counts[ i ]++;
+	}
+    }
+    pThrottle->flags = flags;
+    pThrottle->bValid = true;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  bool throttleActive( const Throttle* pThrottle )
+//	Returns whether the ARM clock is limited right now: capped, throttled
+//	or held at the soft temperature limit
+//------------------------------------------------------------------------------
+bool throttleActive( const Throttle* pThrottle )
+{
+    return pThrottle->bValid &&
+	   (pThrottle->flags & (THROTTLE_FREQ_CAPPED | THROTTLE_THROTTLED |
+				THROTTLE_SOFT_TEMP)) != 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  void throttleClose( Throttle* pThrottle )
+//	Close the mailbox and the cpufreq file.
+//------------------------------------------------------------------------------
+void throttleClose( Throttle* pThrottle )
+{
+    if ( pThrottle->vcioFd >= 0 )
+    {
+	close( pThrottle->vcioFd );
+	pThrottle->vcioFd = -1;
+    }
+    if ( pThrottle->freqFd >= 0 )
+    {
+	close( pThrottle->freqFd );
+	pThrottle->freqFd = -1;
+    }
+}
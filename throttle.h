@@ -0,0 +1,47 @@
+//------------------------------------------------------------------------------
+//  File: 	throttle.h
+//  Date: 	Oct 14, 2026
+//  Author:	Wil van Meurs
+//------------------------------------------------------------------------------
+//
+//  Throttle state of the Raspberry Pi. The firmware throttle flags are read
+//  with the get_throttled property of the VideoCore mailbox (/dev/vcio), the
+//  same request vcgencmd get_throttled makes, but without starting a
+//  process. The current ARM clock is read from cpufreq in sysfs. Both files
+//  are kept open.
+//
+//------------------------------------------------------------------------------
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define THROTTLE_VCIO_PATH	"/dev/vcio"
+#define THROTTLE_FREQ_PATH	\
+	"/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
+
+// Flags of get_throttled; the same flags << 16 tell what occurred since boot
+#define THROTTLE_UNDERVOLTAGE	0x1
+#define THROTTLE_FREQ_CAPPED	0x2
+#define THROTTLE_THROTTLED	0x4
+#define THROTTLE_SOFT_TEMP	0x8	// soft temperature limit active
+#define THROTTLE_NUM_FLAGS	4
+#define THROTTLE_NOW_MASK	0xf
+
+typedef struct Throttle
+{
+    int			vcioFd;		// -1 if there is no mailbox
+    int			freqFd;		// -1 if there is no cpufreq
+    bool		bValid;		// flags could be read
+    uint32_t		flags;		// last get_throttled value
+    long		freqKHz;	// ARM clock, 0 if unknown
+    unsigned long	counts	[ THROTTLE_NUM_FLAGS ];	// times a flag was set
+} Throttle;
+
+int	throttleInit( Throttle* pThrottle );
+int	throttleSample( Throttle* pThrottle );
+bool	throttleActive( const Throttle* pThrottle );
+void	throttleClose( Throttle* pThrottle );
+
+#endif